@@ -48,4 +48,8 @@ cd ..
 cp src/mk_wand_idx bin/mk_wand_idx
 cp src/kstem_query bin/kstem_query
 cp build/wand_search bin/wand_search
+cp build/wand_bench bin/wand_bench
+cp build/wand_loadgen bin/wand_loadgen
+cp build/mk_impact_idx bin/mk_impact_idx
+cp build/wand_verify bin/wand_verify
 echo "Binaries are now in the bin directory"
@@ -11,86 +11,201 @@
 #include "bitpacking.h"
 #include "simdfastpfor.h"
 #include "deltautil.h"
+#include "vbyte_coder.hpp"
+#include "mmap_file.hpp"
 
 #include "sdsl/int_vector.hpp"
 
 using namespace sdsl;
 
-struct vbyte_coder {
-
-  static size_t encode_num(uint32_t num,uint8_t* out) {
-    size_t written_bytes = 0;
-    uint8_t w = num & 0x7F;
-    num >>= 7;
-    while (num > 0) {
-      w |= 0x80; // mark overflow bit
-      *out = w;
-      ++out;
-      w = num & 0x7F;
-      num >>= 7;
-      written_bytes++;
+template<uint64_t t_block_size>
+class block_postings_list;
+
+template<uint64_t t_block_size>
+class shared_block_cache;
+
+template<uint64_t t_block_size>
+class flat_postings;
+
+#pragma pack(push, 1)
+// the largest id of a block and where its compressed ids and freqs start
+struct postings_block_data {
+  uint32_t max_block_id = 0;
+  uint32_t id_offset = 0;
+  uint32_t freq_offset = 0;
+};
+#pragma pack(pop)
+
+// Read-only view of a compressed postings list. It points into the
+// vectors of a block_postings_list or into the arena of a flat_postings
+// index, whose lists do not exist as objects; iterators keep a view
+// rather than a pointer to the list.
+//
+// The ids of dense lists, for which that takes fewer words than the
+// compressed gaps, are a bitmap of all doc ids up to the last one
+// followed by a rank directory with the number of ids before every
+// rank_sample_words words. The id offset of a block is then the bitmap
+// word of its first id. Their freqs are compressed as in other lists.
+template<uint64_t t_block_size>
+struct block_postings_view {
+  using size_type = sdsl::int_vector<>::size_type;
+  using comp_codec = 
+        FastPForLib::OPTPFor<t_block_size/32,FastPForLib::Simple16<false>>;
+  // cache lines of compressed ids and freqs prefetched per block
+  static const uint64_t prefetch_lines = 2;
+  // set in the stored number of id words of a dense list
+  static const uint32_t dense_flag = 1U << 31;
+  static const uint32_t rank_sample_words = 16;
+
+  const postings_block_data* blocks = nullptr;
+  const uint32_t* id_data = nullptr;
+  const uint32_t* freq_data = nullptr;
+  uint32_t size = 0;
+  uint32_t num_blocks = 0;
+  uint32_t id_u32s = 0;
+  uint32_t freq_u32s = 0;
+  bool dense = false;
+
+  // the number of id words as it is stored, with the dense flag
+  uint32_t id_u32s_field() const {
+    return id_u32s | (dense ? dense_flag : 0);
+  }
+
+  uint64_t last_id() const { return blocks[num_blocks-1].max_block_id; }
+
+  // dense lists: the number of ids below id, for id <= last_id()
+  size_type rank(uint64_t id) const {
+    size_t word = id / 32;
+    size_t sample = word / rank_sample_words;
+    const uint32_t* directory = id_data + last_id()/32 + 1;
+    size_type r = directory[sample];
+    for (size_t w=sample*rank_sample_words;w<word;w++) {
+      r += __builtin_popcount(id_data[w]);
     }
-    *out = w;
-    ++out;
-    written_bytes++;
-    return written_bytes;
+    return r + __builtin_popcount(id_data[word] & ((1U << (id % 32)) - 1));
   }
 
-  static uint32_t decode_num(const uint8_t*& in) {
-    uint32_t num = 0;
-    uint8_t w=0;
-    uint32_t shift=0;
-    do {
-      w = *in;
-      in++;    
-      num |= (((uint32_t)(w&0x7F))<<shift);
-      shift += 7;
-    } while ((w&0x80) > 0);
-    return num;
+  // dense lists: the smallest id >= id, for id <= last_id()
+  uint64_t next_id(uint64_t id) const {
+    size_t word = id / 32;
+    uint32_t bits = id_data[word] & (~0U << (id % 32));
+    while (bits == 0) bits = id_data[++word];
+    return word*32 + __builtin_ctz(bits);
   }
 
-  static void encode(const uint32_t* A,
-                     size_t n,
-                     uint32_t* out,
-                     size_t& written_u32s) {
-    uint8_t* out_bytes = (uint8_t*) out;
-    size_t written_bytes = 0;
-    for (size_t i=0;i<n;i++) {
-      size_t written = encode_num(A[i],out_bytes);
-      out_bytes += written;
-      written_bytes += written;
+  size_type postings_in_block(size_type block_id) const {
+    size_type block_size = t_block_size;
+    size_type mod = size % t_block_size;
+    if (block_id == num_blocks-1 && mod != 0) {
+      block_size = mod;
     }
-    written_u32s = written_bytes/4;
-    if (written_bytes%4 != 0) written_u32s++;
+    return block_size;
   }
 
-  static void decode(const uint32_t* in,size_t n,uint32_t* out) {
-    const uint8_t* in_bytes = (const uint8_t*) in;
-    for (size_t i=0;i<n;i++) {
-      *out = decode_num(in_bytes);
-      out++;
+  uint32_t block_rep(size_t bid) const {
+    return blocks[bid].max_block_id;
+  }
+
+  size_type find_block_with_id(uint64_t id,size_t start_block) const {
+    if (dense && (start_block >= num_blocks ||
+                  blocks[start_block].max_block_id < id)) {
+      if (id > last_id()) return num_blocks;
+      return std::max<size_type>(start_block,rank(id) / t_block_size);
+    }
+    size_t block_id = start_block;
+    while (block_id < num_blocks && blocks[block_id].max_block_id < id) {
+      block_id++;
     }
+    return block_id;
   }
-};
 
-template<uint64_t t_block_size>
-class block_postings_list;
+  // decode into buffers of t_block_size words, returns the block size
+  size_type decompress_block(size_t block_id,uint32_t* id_buf,
+                             uint32_t* freq_buf) const
+  {
+    uint32_t delta_offset = 0;
+    if (block_id != 0) {
+      delta_offset = blocks[block_id-1].max_block_id;
+    }
+
+    const uint32_t* id_start = id_data + blocks[block_id].id_offset;
+    const uint32_t* freq_start = freq_data + blocks[block_id].freq_offset;
+    auto block_size = postings_in_block(block_id);
+
+    size_t rec_ids = block_size;
+    size_t rec_freqs;
+    if (block_size == t_block_size) { // PFor
+      // the codec keeps scratch buffers, one per search thread
+      static thread_local comp_codec c;
+      if (!dense) c.decodeBlock(id_start,id_buf,rec_ids);
+      c.decodeBlock(freq_start,freq_buf,rec_freqs);
+    } else { // vbyte
+      if (!dense) vbyte_coder::decode(id_start,block_size,id_buf);
+      vbyte_coder::decode(freq_start,block_size,freq_buf);
+      rec_freqs = block_size;
+    }
+
+    if (dense) {
+      // the set bits after the last id of the previous block
+      size_t word = blocks[block_id].id_offset;
+      uint64_t first = (block_id == 0) ? 0 : delta_offset + 1;
+      uint32_t bits = id_data[word];
+      if (first / 32 == word) bits &= ~0U << (first % 32);
+      for (size_t i=0;i<block_size;i++) {
+        while (bits == 0) bits = id_data[++word];
+        id_buf[i] = word*32 + __builtin_ctz(bits);
+        freq_buf[i]++;
+        bits &= bits - 1;
+      }
+    } else { // undo delta compression
+      id_buf[0] += delta_offset;
+      freq_buf[0]++;
+      for (size_t i=1;i<block_size;i++) {
+        id_buf[i] += id_buf[i-1];
+        freq_buf[i]++;
+      }
+    }
+
+    if (rec_ids != rec_freqs) {
+      std::cerr << "ERROR: number of decoded ids and freqs is not equal. "
+                << rec_ids << " != " << rec_freqs << "\n";
+      throw std::logic_error("number of decoded ids and freqs is not equal.");
+    }
+    return block_size;
+  }
+
+  // Prefetch the compressed data of block_id and the metadata of the
+  // block after it. Called by the iterators when they decode the block
+  // before block_id, so the next block transition does not stall.
+  void prefetch_block(size_t block_id) const {
+    if (block_id >= num_blocks) return;
+    const auto& bd = blocks[block_id];
+    if (block_id+1 < num_blocks) __builtin_prefetch(&blocks[block_id+1]);
+    const char* ids = (const char*)(id_data + bd.id_offset);
+    const char* freqs = (const char*)(freq_data + bd.freq_offset);
+    for (size_t l=0;l<prefetch_lines;l++) {
+      __builtin_prefetch(ids + 64*l);
+      __builtin_prefetch(freqs + 64*l);
+    }
+  }
+};
 
 template<uint64_t t_block_size>
 class plist_iterator
 {
   public:
     typedef block_postings_list<t_block_size> list_type;
-    typedef typename list_type::size_type     size_type;
+    typedef block_postings_view<t_block_size> view_type;
+    typedef typename view_type::size_type     size_type;
     typedef uint64_t                          value_type;
   public: // default implementation used. not necessary to list here
     plist_iterator() = default;
-    plist_iterator(const plist_iterator& pi) = default;
+    plist_iterator(const plist_iterator& pi) { *this = pi; }
     plist_iterator(plist_iterator&& pi) = default;
-    plist_iterator& operator=(const plist_iterator& pi) = default;
+    plist_iterator& operator=(const plist_iterator& pi);
     plist_iterator& operator=(plist_iterator&& pi) = default;
   public:
-    plist_iterator(const list_type& l,size_t pos);
+    plist_iterator(const view_type& l,size_t pos);
     plist_iterator& operator++();
     bool operator ==(const plist_iterator& b) const;
     bool operator !=(const plist_iterator& b) const;
@@ -99,13 +214,24 @@ class plist_iterator
     void skip_to_id(uint64_t id);
     void skip_to_block_with_id(uint64_t id);
     uint64_t block_rep() const { 
-      return m_plist_ptr->block_rep(m_cur_block_id); 
+      return m_list.block_rep(m_cur_block_id); 
     }
-    size_t size() const { return m_plist_ptr->size(); }
+    size_t size() const { return m_list.size; }
     size_t remaining() const { return size() - m_cur_pos; }
     size_t offset() const { return m_cur_pos; }
+    // decode into caller owned buffers of t_block_size words each instead
+    // of the buffer of the iterator
+    void use_buffers(uint32_t* ids,uint32_t* freqs);
+    // take the decoded blocks from a cache shared with the iterators of
+    // other queries over the same list (see shared_block_cache.hpp)
+    void use_shared_blocks(shared_block_cache<t_block_size>* cache,
+                           uint32_t list);
+    // prefetch the block after the one decoded, on by default
+    void prefetch_next_block(bool prefetch) { m_prefetch = prefetch; }
   private:
     void access_and_decode_cur_pos() const;
+    void decode_block(size_type block_id) const;
+    void skip_to_id_dense(uint64_t id);
   private:
     size_type m_cur_pos = std::numeric_limits<uint64_t>::max();
     mutable size_type m_cur_block_id = std::numeric_limits<uint64_t>::max();
@@ -115,9 +241,17 @@ class plist_iterator
             std::numeric_limits<uint64_t>::max()-1;
     mutable value_type m_cur_docid = 0;
     mutable value_type m_cur_freq = 0;
-    const list_type* m_plist_ptr = nullptr;
-    mutable std::vector<uint32_t, FastPForLib::cacheallocator> m_decoded_ids;
-    mutable std::vector<uint32_t, FastPForLib::cacheallocator> m_decoded_freqs;
+    // a dense list skipped to m_cur_docid without decoding its block
+    mutable bool m_freq_pending = false;
+    view_type m_list;
+    mutable uint32_t* m_decoded_ids = nullptr;   // current block, in m_buffer
+    mutable uint32_t* m_decoded_freqs = nullptr; // or set by use_buffers()
+    mutable size_type m_decoded_size = 0;
+    mutable std::vector<uint32_t, FastPForLib::cacheallocator> m_buffer;
+    shared_block_cache<t_block_size>* m_shared = nullptr;
+    uint32_t m_shared_list = 0;
+    mutable uint32_t m_shared_slot = std::numeric_limits<uint32_t>::max();
+    bool m_prefetch = true;
 };
 
 template<uint64_t t_block_size=128>
@@ -125,18 +259,15 @@ class block_postings_list {
 	static_assert(t_block_size % 32 == 0,"blocksize must be multiple of 32.");
   public: // types
 	  friend class plist_iterator<t_block_size>;
-	  using comp_codec = 
-          FastPForLib::OPTPFor<t_block_size/32,FastPForLib::Simple16<false>>;
+	  using view_type = block_postings_view<t_block_size>;
+	  using comp_codec = typename view_type::comp_codec;
 	  using size_type = sdsl::int_vector<>::size_type;
 	  using const_iterator = plist_iterator<t_block_size>;
+	  using shared_cache_type = shared_block_cache<t_block_size>;
+	  using flat_type = flat_postings<t_block_size>;
 	  using pfor_data_type = std::vector<uint32_t, FastPForLib::cacheallocator>;
-	  #pragma pack(push, 1)
-	  struct block_data {
-		  uint32_t max_block_id = 0;
-		  uint32_t id_offset = 0;
-		  uint32_t freq_offset = 0;
-	  };
-	  #pragma pack(pop)
+	  using block_data = postings_block_data;
+	  static const uint64_t block_size = t_block_size;
   public: // actual data
 	  uint32_t m_size = 0;
 	  double m_list_maximum = std::numeric_limits<double>::lowest();
@@ -144,10 +275,18 @@ class block_postings_list {
 	  std::vector<block_data> m_block_data;
     pfor_data_type m_docid_data;
     pfor_data_type m_freq_data;
+    bool m_dense = false;
+    // set if the list is a view of data owned by a flat_postings index
+    view_type m_view;
   public: // default 
     block_postings_list() {
     	m_block_data.resize(1);
     }
+    // a list stored in a flat index
+    block_postings_list(const view_type& view,double list_maximum,
+                        double max_doc_weight)
+      : m_size(view.size), m_list_maximum(list_maximum),
+        m_max_doc_weight(max_doc_weight), m_view(view) {}
     block_postings_list(const block_postings_list& pl) = default;
     block_postings_list(block_postings_list&& pl) = default;
     block_postings_list& operator=(const block_postings_list& pi) = default;
@@ -158,9 +297,20 @@ public: // constructors
     block_postings_list(std::istream& in) {
       load(in);
     }
+    // the list is stored as a bitmap if dense and that is smaller (see
+    // view_type)
     template<class t_rank> 
     block_postings_list(const t_rank& ranker,
-    			  std::vector<std::pair<uint64_t,uint64_t>>& pre_sorted_data) 
+    			  std::vector<std::pair<uint64_t,uint64_t>>& pre_sorted_data,
+    			  bool dense = true) 
+    	: block_postings_list(ranker,pre_sorted_data,pre_sorted_data.size(),
+    	                      dense) {}
+    // a list of f_t postings of which only pre_sorted_data was kept; the
+    // score bounds use the idf of the full list
+    template<class t_rank> 
+    block_postings_list(const t_rank& ranker,
+    			  std::vector<std::pair<uint64_t,uint64_t>>& pre_sorted_data,
+    			  uint64_t f_t,bool dense = true) 
     	: block_postings_list(pre_sorted_data) {
 
     	m_size = pre_sorted_data.size();
@@ -177,10 +327,10 @@ public: // constructors
 	    create_block_support(tmp_data);
 
 	    // create rank support structure
-	    create_rank_support(tmp_data,tmp_freq,ranker);
+	    create_rank_support(tmp_data,tmp_freq,ranker,f_t);
 
 	    // compress postings
-	    compress_postings_data(tmp_data,tmp_freq);
+	    compress_postings_data(tmp_data,tmp_freq,dense);
     }
     block_postings_list(std::vector<std::pair<uint64_t,uint64_t>>& 
       pre_sorted_data) {
@@ -198,7 +348,7 @@ public: // constructors
 	    create_block_support(tmp_data);
 
 	    // compress postings
-	    compress_postings_data(tmp_data,tmp_freq);
+	    compress_postings_data(tmp_data,tmp_freq,true);
     }
   private: // functions used during construction
 	  void create_block_support(const sdsl::int_vector<32>& ids)
@@ -218,10 +368,8 @@ public: // constructors
 	  template<class t_rank>
 	  void create_rank_support(const sdsl::int_vector<32>& ids,
 							               const sdsl::int_vector<32>& freqs,
-							               const t_rank& ranker)
+							               const t_rank& ranker,uint64_t f_t)
 	  {
-		  auto F_t = std::accumulate(freqs.begin(),freqs.end(),0);
-		  auto f_t = ids.size();
 	      for (size_t l=0; l<ids.size(); l++) {
 	        auto id = ids[l];
 	        auto f_dt = freqs[l];
@@ -233,9 +381,41 @@ public: // constructors
 	    }
 	  }
 
+	  // the bitmap and rank directory of the ids of a dense list and the
+	  // id offsets of its blocks, unless they take more than max_words
+	  bool create_dense_ids(const sdsl::int_vector<32>& ids,size_t max_words,
+	                        pfor_data_type& words,
+	                        std::vector<uint32_t>& block_offsets) const
+	  {
+	    const uint32_t sample = view_type::rank_sample_words;
+	    size_t bitmap_words = ids[ids.size()-1]/32 + 1;
+	    size_t num_samples = (bitmap_words + sample - 1) / sample;
+	    if (bitmap_words + num_samples >= max_words) return false;
+	    words.assign(bitmap_words + num_samples,0);
+	    for (size_t i=0;i<ids.size();i++) {
+	      words[ids[i]/32] |= 1U << (ids[i] % 32);
+	    }
+	    uint32_t rank = 0;
+	    for (size_t w=0;w<bitmap_words;w++) {
+	      if (w % sample == 0) words[bitmap_words + w/sample] = rank;
+	      rank += __builtin_popcount(words[w]);
+	    }
+	    block_offsets.clear();
+	    for (size_t i=0;i<ids.size();i+=t_block_size) {
+	      block_offsets.push_back(ids[i]/32);
+	    }
+	    return true;
+	  }
+
 	  void compress_postings_data(const sdsl::int_vector<32>& ids,
-	            					        sdsl::int_vector<32>& freqs)
+	            					        sdsl::int_vector<32>& freqs,bool dense)
 	  {
+	    // bitmaps only pay off below a word per posting
+	    pfor_data_type dense_ids;
+	    std::vector<uint32_t> dense_offsets;
+	    m_dense = dense && !ids.empty() &&
+	              create_dense_ids(ids,ids.size(),dense_ids,dense_offsets);
+
 		  // delta compress ids first
 		  uint32_t* id_input = (uint32_t*) ids.data();
 		  FastPForLib::Delta::fastDelta(id_input,ids.size());
@@ -281,64 +461,64 @@ public: // constructors
 	    }
 	    m_docid_data.resize(id_offset);
 	    m_docid_data.shrink_to_fit();
+	    m_dense = m_dense && dense_ids.size() < id_offset;
+	    if (m_dense) {
+	      m_docid_data.swap(dense_ids);
+	      for (size_t b=0;b<m_block_data.size();b++) {
+	        m_block_data[b].id_offset = dense_offsets[b];
+	      }
+	    }
 	    m_freq_data.resize(freq_offset);
 	    m_freq_data.shrink_to_fit();
 	  }
   public: // functions used during processing
+    // the compressed data of the list, wherever it is stored
+    view_type view() const {
+      if (m_view.blocks != nullptr) return m_view;
+      view_type v;
+      v.blocks = m_block_data.data();
+      v.id_data = m_docid_data.data();
+      v.freq_data = m_freq_data.data();
+      v.size = m_size;
+      v.num_blocks = m_block_data.size();
+      v.id_u32s = m_docid_data.size();
+      v.freq_u32s = m_freq_data.size();
+      v.dense = m_dense;
+      return v;
+    }
+
 	  void decompress_block(size_t block_id,
 	            					  pfor_data_type& id_data,
 						              pfor_data_type& freq_data) const
 	  {
-		  uint32_t delta_offset = 0;
-		  if (block_id != 0) {
-			  delta_offset = m_block_data[block_id-1].max_block_id;
-		  }
-
-		  const uint32_t* id_start = m_docid_data.data() + 
-                                 m_block_data[block_id].id_offset;
-		  const uint32_t* freq_start = m_freq_data.data() + 
-							                     m_block_data[block_id].freq_offset;
-		  auto block_size = postings_in_block(block_id);
-
+	    auto block_size = postings_in_block(block_id);
 	    if (id_data.size() != block_size) { // did we allocate space already?
 	      id_data.resize(block_size);
 	      freq_data.resize(block_size);
 	    }
+	    decompress_block(block_id,id_data.data(),freq_data.data());
+	  }
 
-	    size_t rec_ids;
-	    size_t rec_freqs;
-		  if (block_size == t_block_size) { // PFor
-			  static comp_codec c;
-			  c.decodeBlock(id_start,id_data.data(),rec_ids);
-			  c.decodeBlock(freq_start,freq_data.data(),rec_freqs);
-		  } else { // vbyte
-			  vbyte_coder::decode(id_start,block_size,id_data.data());
-			  vbyte_coder::decode(freq_start,block_size,freq_data.data());
-			  rec_ids = rec_freqs = block_size;
-		  }
+	  // decode into buffers of t_block_size words, returns the block size
+	  size_type decompress_block(size_t block_id,uint32_t* id_data,
+	                             uint32_t* freq_data) const
+	  {
+	    return view().decompress_block(block_id,id_data,freq_data);
+	  }
 
-		  // undo delta compression
-		  id_data[0] += delta_offset;
-      freq_data[0]++;
-		  for (size_t i=1;i<block_size;i++) {
-			  id_data[i] += id_data[i-1];
-        freq_data[i]++;
-		  }
+	  void prefetch_block(size_t block_id) const {
+	    view().prefetch_block(block_id);
+	  }
 
-		  if (rec_ids != rec_freqs) {
-	      std::cerr << "ERROR: number of decoded ids and freqs is not equal. "
-	                << rec_ids << " != " << rec_freqs << "\n";
-	      throw std::logic_error("number of decoded ids and freqs is not equal.");
-		  }
+	  size_t advise_huge_pages() const {
+	    return ::advise_huge_pages(m_docid_data.data(),
+	                               m_docid_data.size()*sizeof(uint32_t)) +
+	           ::advise_huge_pages(m_freq_data.data(),
+	                               m_freq_data.size()*sizeof(uint32_t));
 	  }
 
 	  size_type find_block_with_id(uint64_t id,size_t start_block) const {
-	    size_t block_id = start_block;
-	    size_t nblocks = m_block_data.size();
-	    while (block_id < nblocks && m_block_data[block_id].max_block_id < id) {
-	      block_id++;
-	    }
-	    return block_id;
+	    return view().find_block_with_id(id,start_block);
 	  }
 
 	  size_type size() const {
@@ -346,28 +526,23 @@ public: // constructors
 	  }
 
 	  uint32_t block_rep(size_t bid) const {
-		  return m_block_data[bid].max_block_id;
+		  return view().block_rep(bid);
 	  }
 
 	  size_type num_blocks() const {
-		  return m_block_data.size();
+		  return view().num_blocks;
 	  }
 
 	  size_type postings_in_block(size_type block_id) const {
-		  size_type block_size = t_block_size;
-		  size_type mod = m_size % t_block_size;
-		  if (block_id == m_block_data.size()-1 && mod != 0) {
-			  block_size = mod;
-		  }
-		  return block_size;
+		  return view().postings_in_block(block_id);
 	  }
 
     const_iterator begin() const {
-      return const_iterator(*this,0);
+      return const_iterator(view(),0);
     }
 
     const_iterator end() const {
-      return const_iterator(*this,m_size);
+      return const_iterator(view(),m_size);
     }
 
     auto serialize(std::ostream& out, sdsl::structure_tree_node* v = nullptr, 
@@ -375,6 +550,7 @@ public: // constructors
 	  {
 
 	    size_type written_bytes = 0;
+	    auto lv = view();
 
 		  sdsl::structure_tree_node* child;
 	    if (m_size <= t_block_size) { // only one block
@@ -390,38 +566,35 @@ public: // constructors
 	    written_bytes += sdsl::write_member(m_size,out,child,"size");
 
 	    if (m_size <= t_block_size) { // only one block
-	     	written_bytes += sdsl::write_member(m_block_data[0].max_block_id,out,
+	     	written_bytes += sdsl::write_member(lv.blocks[0].max_block_id,out,
                                             child,"max block id");
 	    } else {
 	    	auto* blockdata = sdsl::structure_tree::add_child(child, "block data",
                                                           "block data");
-	    	out.write((const char*)m_block_data.data(), 
-                  m_block_data.size()*sizeof(block_data));
-	    	written_bytes += m_block_data.size()*sizeof(block_data);
+	    	out.write((const char*)lv.blocks, lv.num_blocks*sizeof(block_data));
+	    	written_bytes += lv.num_blocks*sizeof(block_data);
 	    	sdsl::structure_tree::add_size(blockdata, 
-                                       m_block_data.size()*sizeof(block_data));
+                                       lv.num_blocks*sizeof(block_data));
 	    }
 
-      uint32_t docidu32 = m_docid_data.size();
-      uint32_t frequ32 = m_freq_data.size();
-      written_bytes += sdsl::write_member(docidu32,out,child,"docid u32s");
+      uint32_t docidu32 = lv.id_u32s;
+      uint32_t frequ32 = lv.freq_u32s;
+      uint32_t docidu32_field = lv.id_u32s_field();
+      written_bytes += sdsl::write_member(docidu32_field,out,child,
+                                          "docid u32s");
       written_bytes += sdsl::write_member(frequ32,out,child,"freq u32s");
 
     	auto* idchild = sdsl::structure_tree::add_child(child, "id data",
-                                                      "delta compressed");
-      out.write((const char*)m_docid_data.data(), 
-                m_docid_data.size()*sizeof(uint32_t));
-      sdsl::structure_tree::add_size(idchild, 
-                                     m_docid_data.size()*sizeof(uint32_t));
-      written_bytes +=  m_docid_data.size()*sizeof(uint32_t);
+                                   lv.dense ? "bitmap" : "delta compressed");
+      out.write((const char*)lv.id_data, docidu32*sizeof(uint32_t));
+      sdsl::structure_tree::add_size(idchild, docidu32*sizeof(uint32_t));
+      written_bytes +=  docidu32*sizeof(uint32_t);
 
       auto* fchild = sdsl::structure_tree::add_child(child, "freq data", 
                                                      "compressed");
-      out.write((const char*)m_freq_data.data(), 
-                m_freq_data.size()*sizeof(uint32_t));
-      written_bytes +=  m_freq_data.size()*sizeof(uint32_t);
-    	sdsl::structure_tree::add_size(fchild, 
-                                     m_freq_data.size()*sizeof(uint32_t));
+      out.write((const char*)lv.freq_data, frequ32*sizeof(uint32_t));
+      written_bytes +=  frequ32*sizeof(uint32_t);
+    	sdsl::structure_tree::add_size(fchild, frequ32*sizeof(uint32_t));
 
 	    written_bytes += sdsl::write_member(m_list_maximum,out,
                                           child,"list max score");
@@ -433,6 +606,7 @@ public: // constructors
 	  }
 
 	  void load(std::istream& in) {
+		  m_view = view_type();
 		  read_member(m_size,in);
 		  if (m_size <= t_block_size) { // only one block
 			  uint32_t max_block_id;
@@ -451,6 +625,8 @@ public: // constructors
       uint32_t frequ32;
       read_member(docidu32,in);
       read_member(frequ32,in);
+      m_dense = (docidu32 & view_type::dense_flag) != 0;
+      docidu32 &= ~view_type::dense_flag;
       m_docid_data.resize(docidu32);
       m_freq_data.resize(frequ32);
       in.read((char*)m_docid_data.data(),docidu32*sizeof(uint32_t));
@@ -463,11 +639,91 @@ public: // constructors
 
 
 template<uint64_t t_bs>
-plist_iterator<t_bs>::plist_iterator(const list_type& l,
+plist_iterator<t_bs>::plist_iterator(const view_type& l,
                                      size_t pos) : plist_iterator()
 {
   m_cur_pos = pos;
-  m_plist_ptr = &l;
+  m_list = l;
+}
+
+template<uint64_t t_bs>
+plist_iterator<t_bs>& 
+plist_iterator<t_bs>::operator=(const plist_iterator& pi)
+{
+  m_cur_pos = pi.m_cur_pos;
+  m_cur_block_id = pi.m_cur_block_id;
+  m_last_accessed_block = pi.m_last_accessed_block;
+  m_last_accessed_id = pi.m_last_accessed_id;
+  m_cur_docid = pi.m_cur_docid;
+  m_cur_freq = pi.m_cur_freq;
+  m_freq_pending = pi.m_freq_pending;
+  m_list = pi.m_list;
+  m_prefetch = pi.m_prefetch;
+  m_decoded_size = pi.m_decoded_size;
+  m_buffer = pi.m_buffer;
+  m_shared = nullptr;
+  m_shared_slot = std::numeric_limits<uint32_t>::max();
+  if (pi.m_shared != nullptr) {
+    // a copy holds no pin on the shared block, it decodes its own
+    m_decoded_ids = nullptr;
+    m_decoded_freqs = nullptr;
+    m_decoded_size = 0;
+    m_last_accessed_block = std::numeric_limits<uint64_t>::max()-1;
+    m_last_accessed_id = std::numeric_limits<uint64_t>::max()-1;
+  } else if (!pi.m_buffer.empty() && pi.m_decoded_ids == pi.m_buffer.data()) {
+    // point to the copy of the block
+    m_decoded_ids = m_buffer.data();
+    m_decoded_freqs = m_decoded_ids + t_bs;
+  } else {
+    m_decoded_ids = pi.m_decoded_ids;
+    m_decoded_freqs = pi.m_decoded_freqs;
+  }
+  return *this;
+}
+
+template<uint64_t t_bs>
+void plist_iterator<t_bs>::use_buffers(uint32_t* ids,uint32_t* freqs)
+{
+  m_decoded_ids = ids;
+  m_decoded_freqs = freqs;
+  m_decoded_size = 0;
+  m_last_accessed_block = std::numeric_limits<uint64_t>::max()-1;
+  m_last_accessed_id = std::numeric_limits<uint64_t>::max()-1;
+}
+
+template<uint64_t t_bs>
+void plist_iterator<t_bs>::use_shared_blocks(shared_block_cache<t_bs>* cache,
+                                             uint32_t list)
+{
+  use_buffers(nullptr,nullptr);
+  m_shared = cache;
+  m_shared_list = list;
+  m_shared_slot = std::numeric_limits<uint32_t>::max();
+}
+
+template<uint64_t t_bs>
+void plist_iterator<t_bs>::decode_block(size_type block_id) const
+{
+  if (m_shared != nullptr) {
+    if (m_shared_slot != std::numeric_limits<uint32_t>::max()) {
+      m_shared->release(m_shared_slot);
+    }
+    m_last_accessed_block = block_id;
+    m_shared_slot = m_shared->acquire(m_shared_list,block_id,m_decoded_ids,
+                                      m_decoded_freqs,m_decoded_size);
+    return;
+  }
+  if (m_decoded_ids == nullptr) {
+    m_buffer.resize(2*t_bs);
+    m_decoded_ids = m_buffer.data();
+    m_decoded_freqs = m_decoded_ids + t_bs;
+  }
+  m_last_accessed_block = block_id;
+  m_decoded_size = m_list.decompress_block(block_id,m_decoded_ids,
+                                                 m_decoded_freqs);
+  if (m_prefetch) {
+    m_list.prefetch_block(block_id+1);
+  }
 }
 
 template<uint64_t t_bs>
@@ -486,7 +742,7 @@ template<uint64_t t_bs>
 bool plist_iterator<t_bs>::operator ==(const plist_iterator& b) const
 {
   return ((*this).m_cur_pos == b.m_cur_pos) && 
-          ((*this).m_plist_ptr == b.m_plist_ptr);
+          ((*this).m_list.blocks == b.m_list.blocks);
 }
 
 template<uint64_t t_bs>
@@ -498,7 +754,7 @@ bool plist_iterator<t_bs>::operator !=(const plist_iterator& b) const
 template<uint64_t t_bs>
 typename plist_iterator<t_bs>::value_type plist_iterator<t_bs>::docid() const
 {
-  if (m_cur_pos == m_plist_ptr->size()) { // end?
+  if (m_cur_pos == m_list.size) { // end?
     std::cerr << "ERROR: plist iterator dereferenced at list end.\n";
     throw std::out_of_range("plist iterator dereferenced at list end");
   }
@@ -512,11 +768,11 @@ typename plist_iterator<t_bs>::value_type plist_iterator<t_bs>::docid() const
 template<uint64_t t_bs>
 typename plist_iterator<t_bs>::value_type plist_iterator<t_bs>::freq() const
 {
-  if (m_cur_pos == m_plist_ptr->size()) { // end?
+  if (m_cur_pos == m_list.size) { // end?
     std::cerr << "ERROR: plist iterator dereferenced at list end.\n";
     throw std::out_of_range("plist iterator dereferenced at list end");
   }
-  if (m_cur_pos == m_last_accessed_id) {
+  if (m_cur_pos == m_last_accessed_id && !m_freq_pending) {
     return m_cur_freq;
   }
   access_and_decode_cur_pos();
@@ -528,61 +784,89 @@ void plist_iterator<t_bs>::access_and_decode_cur_pos() const
 {
   m_cur_block_id = m_cur_pos / t_bs;
   if (m_cur_block_id != m_last_accessed_block) {  // decompress block
-    m_last_accessed_block = m_cur_block_id;
-    m_plist_ptr->decompress_block(m_cur_block_id,m_decoded_ids,m_decoded_freqs);
+    decode_block(m_cur_block_id);
   }
   size_t in_block_offset = m_cur_pos % t_bs;
   m_cur_docid = m_decoded_ids[in_block_offset];
   m_cur_freq = m_decoded_freqs[in_block_offset];
   m_last_accessed_id = m_cur_pos;
+  m_freq_pending = false;
 }
 
 template<uint64_t t_bs>
 void plist_iterator<t_bs>::skip_to_block_with_id(uint64_t id)
 {
   size_t old_block = m_cur_block_id;
-  m_cur_block_id = m_plist_ptr->find_block_with_id(id,m_cur_block_id);
+  m_cur_block_id = m_list.find_block_with_id(id,m_cur_block_id);
 
   // we now go to the first id in the new block!
   if (old_block != m_cur_block_id) {
     m_cur_pos = m_cur_block_id*t_bs;
-    if (m_cur_pos > m_plist_ptr->size()) { // don't go past the end!
-      m_cur_pos = m_plist_ptr->size();
+    if (m_cur_pos > m_list.size) { // don't go past the end!
+      m_cur_pos = m_list.size;
     }
   }
 }
 
+// A bit probe and a rank in the bitmap; the block with the freq is only
+// decoded if freq() is called.
+template<uint64_t t_bs>
+void plist_iterator<t_bs>::skip_to_id_dense(uint64_t id)
+{
+  if (m_cur_pos == m_list.size) return;
+  if (id > m_list.last_id()) {
+    m_cur_pos = m_list.size;
+    return;
+  }
+  size_type pos = m_list.rank(id);
+  if (pos <= m_cur_pos) return; // already at an id >= id
+  m_cur_pos = pos;
+  m_cur_block_id = pos / t_bs;
+  m_cur_docid = m_list.next_id(id);
+  m_last_accessed_id = pos;
+  m_freq_pending = true;
+}
+
 template<uint64_t t_bs>
 void plist_iterator<t_bs>::skip_to_id(uint64_t id)
 {
   if (id == m_cur_docid) {
     return;
   }
+  if (m_list.dense && (m_last_accessed_block != m_cur_block_id ||
+                       m_list.block_rep(m_cur_block_id) < id)) {
+    // unless the id is in the decoded block
+    skip_to_id_dense(id);
+    return;
+  }
 
   skip_to_block_with_id(id);
   // check if we reached list end!
-  if (m_cur_block_id >= m_plist_ptr->num_blocks()) {
-    m_cur_pos = m_plist_ptr->size();
+  if (m_cur_block_id >= m_list.num_blocks) {
+    m_cur_pos = m_list.size;
     return;
   }
   if (m_last_accessed_block != m_cur_block_id) {
-    m_last_accessed_block = m_cur_block_id;
-    m_plist_ptr->decompress_block(m_cur_block_id,m_decoded_ids,m_decoded_freqs);
-    auto block_itr = std::lower_bound(m_decoded_ids.begin(),
-                                      m_decoded_ids.end(),id);
+    decode_block(m_cur_block_id);
+    auto block_itr = std::lower_bound(m_decoded_ids,
+                                      m_decoded_ids+m_decoded_size,id);
     m_cur_pos = (t_bs*m_cur_block_id) + 
-                std::distance(m_decoded_ids.begin(),block_itr);
+                std::distance(m_decoded_ids,block_itr);
   } else {
     size_t in_block_offset = m_cur_pos % t_bs;
-    auto block_itr = std::lower_bound(m_decoded_ids.begin()+in_block_offset,
-                                      m_decoded_ids.end(),id);
+    auto block_itr = std::lower_bound(m_decoded_ids+in_block_offset,
+                                      m_decoded_ids+m_decoded_size,id);
     m_cur_pos = (t_bs*m_cur_block_id) + 
-                std::distance(m_decoded_ids.begin(),block_itr);
+                std::distance(m_decoded_ids,block_itr);
   }
   size_t inblock_offset = m_cur_pos % t_bs;
   m_cur_docid = m_decoded_ids[inblock_offset];
   m_cur_freq = m_decoded_freqs[inblock_offset];
   m_last_accessed_id = m_cur_pos;
+  m_freq_pending = false;
 }
 
+// iterators decoding through a shared cache need its definition
+#include "shared_block_cache.hpp"
+
 #endif
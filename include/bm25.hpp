@@ -7,16 +7,32 @@
 #include <string>
 #include <vector>
 
+// Rankers are plugged into idx_invfile through t_rank. Besides
+// calculate_docscore(), which is used at construction time to compute the
+// list maxima for f_qt = 1, a ranker provides the query time interface
+//   query_term_weight(f_qt,f_t)          once per query term
+//   posting_score(w_qt,f_dt,doc_id)      once per posting
+//   max_posting_score(list_max,w_qt,f_t) bound of posting_score()
+// posting_score() must be linear in w_qt so that the stored list maxima
+// can be scaled to the weight of the query term.
+//
+// k1 and b are parameters of the ranker and default to t_k1/100 and
+// t_b/100, the parameters of the list maxima of mk_wand_idx. The list
+// maxima of an index whose ranker has other ones must be recomputed
+// (idx_invfile::set_list_maxima).
 template<uint32_t t_k1=90,uint32_t t_b=40>
 struct my_rank_bm25 {
-  static const double k1;
-  static const double b;
+  static constexpr double default_k1 = t_k1/100.0;
+  static constexpr double default_b = t_b/100.0;
   static const double epsilon_score;
-  size_t num_docs;
-  size_t num_terms;
-  double avg_doc_len;
-  double min_doc_len;
+  double k1 = default_k1;
+  double b = default_b;
+  size_t num_docs = 0;
+  size_t num_terms = 0;
+  double avg_doc_len = 0;
+  double min_doc_len = 0;
   std::vector<uint64_t> doc_lengths;
+  std::vector<float> doc_norms; // K_d of every document
   static std::string name() {
     return "bm25";
   }
@@ -27,9 +43,14 @@ struct my_rank_bm25 {
           uint64_t terms) : my_rank_bm25(doc_len, terms, doc_len.size()) { }
 
   my_rank_bm25(std::vector<uint64_t> doc_len, 
-          uint64_t terms, uint64_t numdocs) : num_docs(numdocs), 
-          avg_doc_len((double)terms/(double)numdocs) {
+          uint64_t terms, uint64_t numdocs, double k1_param = default_k1,
+          double b_param = default_b) : k1(k1_param), b(b_param),
+          num_docs(numdocs), avg_doc_len((double)terms/(double)numdocs) {
     doc_lengths = std::move(doc_len); //Takes ownership of the vector!
+    doc_norms.resize(doc_lengths.size());
+    for (size_t i=0;i<doc_lengths.size();i++) {
+      doc_norms[i] = k1*((1-b) + (b*(doc_lengths[i]/avg_doc_len)));
+    }
 
     std::cerr<<"num_docs = "<<num_docs<<std::endl;
     std::cerr<<"avg_doc_len = "<<avg_doc_len<<std::endl;
@@ -49,14 +70,29 @@ struct my_rank_bm25 {
     double w_dt = ((k1+1)*f_dt) / (K_d + f_dt);
     return w_dt*w_qt;
   }
+
+  // idf part of the score, including the (k1+1) of the tf part
+  double query_term_weight(const double f_qt,const double f_t) const {
+    return (k1+1) * std::max(epsilon_score,
+                    std::log((num_docs - f_t + 0.5) / (f_t+0.5)) * f_qt);
+  }
+  double posting_score(const double w_qt,const double f_dt,
+                       uint64_t doc_id) const {
+    return w_qt * f_dt / (doc_norms[doc_id] + f_dt);
+  }
+  // the slack covers the rounding of the float normalizers
+  double max_posting_score(const double list_max_score,const double w_qt,
+                           const double f_t) const {
+    return list_max_score * (w_qt / query_term_weight(1.0,f_t)) * (1+1e-6);
+  }
 };
 
 /*SUPER IMPORTANT*/
 template<uint32_t t_k1,uint32_t t_b>
-const double my_rank_bm25<t_k1,t_b>::k1 = (double)t_k1/100.0;
+constexpr double my_rank_bm25<t_k1,t_b>::default_k1;
 
 template<uint32_t t_k1,uint32_t t_b>
-const double my_rank_bm25<t_k1,t_b>::b = (double)t_b/100.0;
+constexpr double my_rank_bm25<t_k1,t_b>::default_b;
 
 template<uint32_t t_k1,uint32_t t_b>
 const double my_rank_bm25<t_k1,t_b>::epsilon_score = 1e-6;
@@ -0,0 +1,64 @@
+#ifndef CONCURRENT_QUEUE_HPP
+#define CONCURRENT_QUEUE_HPP
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+// Multi-producer/multi-consumer queue, unbounded unless given a capacity,
+// in which case push() blocks while the queue is full. After close()
+// producers can no longer push and consumers drain the remaining items
+// before pop() returns false.
+template<class t_item>
+class concurrent_queue {
+private:
+  std::deque<t_item> m_items;
+  std::mutex m_mutex;
+  std::condition_variable m_cv;
+  std::condition_variable m_not_full;
+  size_t m_capacity;
+  bool m_closed = false;
+public:
+  explicit concurrent_queue(size_t capacity = 0) : m_capacity(capacity) {}
+
+  bool push(t_item item) {
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_not_full.wait(lock,[this]() {
+        return m_closed || m_capacity == 0 || m_items.size() < m_capacity;
+      });
+      if (m_closed) return false;
+      m_items.push_back(std::move(item));
+    }
+    m_cv.notify_one();
+    return true;
+  }
+
+  bool pop(t_item& item) {
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_cv.wait(lock,[this]() { return m_closed || !m_items.empty(); });
+      if (m_items.empty()) return false;
+      item = std::move(m_items.front());
+      m_items.pop_front();
+    }
+    if (m_capacity != 0) m_not_full.notify_one();
+    return true;
+  }
+
+  void close() {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_closed = true;
+    }
+    m_cv.notify_all();
+    m_not_full.notify_all();
+  }
+
+  size_t size() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_items.size();
+  }
+};
+
+#endif
@@ -0,0 +1,84 @@
+#ifndef DOCNO_TABLE_HPP
+#define DOCNO_TABLE_HPP
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "front_coded_vector.hpp"
+#include "mmap_file.hpp"
+
+// Document names (TREC docnos) in docid order, written by mk_wand_idx as
+// doc_names.bin:
+//   uint64_t magic, front_coded_vector names
+// Consecutive docnos share long prefixes, so front coding shrinks them
+// considerably. The file is memory mapped and only the buckets of the
+// requested documents are decoded.
+class docno_table {
+public:
+  static const uint64_t magic = 0x31434f4e4f444e57ULL; // "WNDODOC1"
+  static const uint64_t bucket_size = 16;
+private:
+  mmap_file m_file;
+  std::vector<uint64_t> m_buffer; // used if not memory mapped
+  front_coded_vector m_names;
+private:
+  void map(const uint8_t* data,size_t size,const std::string& name) {
+    const uint64_t* header = (const uint64_t*) data;
+    if (size < 2*sizeof(uint64_t) || header[0] != magic) {
+      std::cerr << "ERROR: " << name << " is not a docno table." << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    m_names.map(data + sizeof(uint64_t));
+  }
+public:
+  docno_table() = default;
+  docno_table(docno_table&&) = default;
+  docno_table& operator=(docno_table&&) = default;
+
+  // memory map a table written by serialize()
+  explicit docno_table(const std::string& file_name) : m_file(file_name) {
+    map(m_file.data(),m_file.size(),file_name);
+  }
+
+  // build the table in memory from a doc_names.txt file
+  static docno_table from_text(const std::string& file_name) {
+    std::vector<std::string> names;
+    std::ifstream dfs(file_name);
+    if (!dfs.is_open()) {
+      std::cerr << "Could not open file: " << file_name << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    std::string name;
+    while( std::getline(dfs,name) ) {
+      names.push_back(name);
+    }
+    std::ostringstream out;
+    serialize(names,out);
+    auto bytes = out.str();
+
+    docno_table table;
+    table.m_buffer.resize((bytes.size()+7)/8);
+    memcpy(table.m_buffer.data(),bytes.data(),bytes.size());
+    table.map((const uint8_t*)table.m_buffer.data(),bytes.size(),file_name);
+    return table;
+  }
+
+  static void serialize(const std::vector<std::string>& names,
+                        std::ostream& out) {
+    uint64_t header = magic;
+    out.write((const char*)&header,sizeof(header));
+    front_coded_vector::serialize(names,bucket_size,out);
+  }
+
+  uint64_t size() const { return m_names.size(); }
+
+  // name of doc_id, empty if there is no such document
+  std::string operator[](uint64_t doc_id) const {
+    if (doc_id >= m_names.size()) return "";
+    return m_names[doc_id];
+  }
+};
+
+#endif
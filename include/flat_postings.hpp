@@ -0,0 +1,219 @@
+#ifndef FLAT_POSTINGS_HPP
+#define FLAT_POSTINGS_HPP
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+#include "block_postings_list.hpp"
+#include "mmap_file.hpp"
+
+// The postings lists of an index without a block_postings_list object per
+// term. The compressed data of all lists lives in one arena and every term
+// has a 32 byte descriptor. Lists of a single block whose ids and freqs
+// each take one word, which are most of the terms of a large vocabulary,
+// are stored in the descriptor itself. list(t) returns a view of term t
+// that iterates like the list it was built from.
+//
+// The on-disk format is the one of the block_postings_list objects, so
+// an index file is read list by list straight into the arena. The score
+// bounds are kept as floats rounded up, so they stay upper bounds.
+template<uint64_t t_block_size>
+class flat_postings {
+public:
+  using list_type = block_postings_list<t_block_size>;
+  using view_type = block_postings_view<t_block_size>;
+  using block_data = postings_block_data;
+  using size_type = typename list_type::size_type;
+private:
+  static const uint32_t in_place_flag = 1U << 31;
+  static const uint32_t dense_flag = view_type::dense_flag;
+  static const uint32_t block_words = sizeof(block_data)/sizeof(uint32_t);
+  #pragma pack(push, 1)
+  struct descriptor {
+    uint32_t size = 0;  // in_place_flag is set for lists stored in place
+    float list_max_score = 0;
+    float max_doc_weight = 0;
+    // lists in the arena: arena offset (two words), id words with the
+    // dense flag, freq words.
+    // lists in place: the block data, the id word and the freq word.
+    uint32_t data[5] = {0,0,0,0,0};
+  };
+  #pragma pack(pop)
+  static_assert(sizeof(descriptor) == 32,"descriptors take 32 bytes.");
+  static_assert(sizeof(block_data) == 3*sizeof(uint32_t),
+                "block data is three words.");
+  std::vector<descriptor> m_lists;
+  std::vector<uint32_t, FastPForLib::cacheallocator> m_arena;
+  size_t m_in_place = 0;
+  size_t m_dense = 0;
+private:
+  // nearest float which is not smaller than x
+  static float round_up(double x) {
+    float f = (float)x;
+    if ((double)f < x) {
+      f = std::nextafter(f,std::numeric_limits<float>::infinity());
+    }
+    return f;
+  }
+  static size_type num_blocks(uint32_t size) {
+    if (size <= t_block_size) return 1;
+    return (size + t_block_size - 1) / t_block_size;
+  }
+  static bool fits_in_place(uint32_t size,uint32_t id_u32s,uint32_t freq_u32s) {
+    return size <= t_block_size && id_u32s <= 1 && freq_u32s <= 1;
+  }
+  // Add the descriptor of a list and return where its ids and freqs go,
+  // after its block data: in the descriptor, whose data has the same
+  // layout as a list of one block in the arena, or at the end of the
+  // arena. The blocks of a list of several blocks are already at offset.
+  uint32_t* add_list(uint32_t size,const block_data& single,uint64_t offset,
+                     uint32_t id_u32s_field,uint32_t freq_u32s) {
+    uint32_t id_u32s = id_u32s_field & ~dense_flag;
+    m_lists.emplace_back();
+    auto& d = m_lists.back();
+    d.size = size;
+    if (fits_in_place(size,id_u32s_field,freq_u32s)) {
+      d.size |= in_place_flag;
+      memcpy(d.data,&single,sizeof(block_data));
+      m_in_place++;
+      return d.data + block_words;
+    }
+    d.data[0] = (uint32_t)offset;
+    d.data[1] = (uint32_t)(offset >> 32);
+    d.data[2] = id_u32s_field;
+    d.data[3] = freq_u32s;
+    if (id_u32s_field & dense_flag) m_dense++;
+    if (size <= t_block_size) {
+      m_arena.resize(offset + block_words);
+      memcpy(m_arena.data() + offset,&single,sizeof(block_data));
+    }
+    size_t words_start = m_arena.size();
+    m_arena.resize(words_start + id_u32s + freq_u32s);
+    return m_arena.data() + words_start;
+  }
+  void set_bounds(double list_max_score,double max_doc_weight) {
+    m_lists.back().list_max_score = round_up(list_max_score);
+    m_lists.back().max_doc_weight = round_up(max_doc_weight);
+  }
+public:
+  flat_postings() = default;
+
+  // read num_lists serialized block_postings_lists. size_hint is an upper
+  // bound of the bytes to read, e.g. the file size; the arena is reserved
+  // for it so that it is not copied while it grows.
+  void load(std::istream& in,size_t num_lists,size_t size_hint = 0) {
+    m_lists.clear();
+    m_arena.clear();
+    m_in_place = 0;
+    m_dense = 0;
+    m_lists.reserve(num_lists);
+    if (size_hint) m_arena.reserve(size_hint / sizeof(uint32_t));
+    for (size_t i=0;i<num_lists;i++) {
+      uint32_t size;
+      read_member(size,in);
+      if (size >= in_place_flag) {
+        throw std::length_error("postings list too long for a flat index.");
+      }
+      uint64_t offset = m_arena.size();
+      block_data single;
+      if (size <= t_block_size) {
+        read_member(single.max_block_id,in);
+      } else {
+        size_type nb = num_blocks(size);
+        m_arena.resize(offset + nb*block_words);
+        in.read((char*)(m_arena.data() + offset),nb*sizeof(block_data));
+      }
+      uint32_t id_u32s_field, freq_u32s;
+      read_member(id_u32s_field,in);
+      read_member(freq_u32s,in);
+      uint32_t id_u32s = id_u32s_field & ~dense_flag;
+      uint32_t* words = add_list(size,single,offset,id_u32s_field,freq_u32s);
+      in.read((char*)words,(id_u32s + freq_u32s)*sizeof(uint32_t));
+      double list_max_score, max_doc_weight;
+      read_member(list_max_score,in);
+      read_member(max_doc_weight,in);
+      set_bounds(list_max_score,max_doc_weight);
+    }
+    if (!in) {
+      throw std::runtime_error("postings file is truncated.");
+    }
+  }
+
+  // copy lists built in memory
+  explicit flat_postings(const std::vector<list_type>& lists) {
+    m_lists.reserve(lists.size());
+    for (const auto& pl : lists) {
+      auto v = pl.view();
+      if (v.size >= in_place_flag) {
+        throw std::length_error("postings list too long for a flat index.");
+      }
+      uint64_t offset = m_arena.size();
+      if (v.size > t_block_size) {
+        m_arena.resize(offset + v.num_blocks*block_words);
+        memcpy(m_arena.data() + offset,v.blocks,
+               v.num_blocks*sizeof(block_data));
+      }
+      uint32_t* words = add_list(v.size,v.blocks[0],offset,
+                                 v.id_u32s_field(),v.freq_u32s);
+      // empty lists have no data to copy
+      if (v.size > 0) {
+        memcpy(words,v.id_data,v.id_u32s*sizeof(uint32_t));
+        memcpy(words + v.id_u32s,v.freq_data,v.freq_u32s*sizeof(uint32_t));
+      }
+      set_bounds(pl.list_max_score(),pl.max_doc_weight());
+    }
+  }
+
+  size_t size() const { return m_lists.size(); }
+
+  void set_list_max_score(size_t t,double list_max_score) {
+    m_lists[t].list_max_score = round_up(list_max_score);
+  }
+
+  // the list of term t; it points into this index
+  list_type list(size_t t) const {
+    const auto& d = m_lists[t];
+    view_type v;
+    v.size = d.size & ~in_place_flag;
+    v.num_blocks = num_blocks(v.size);
+    if (d.size & in_place_flag) {
+      v.blocks = (const block_data*)d.data;
+      v.id_data = d.data + block_words;
+      v.freq_data = d.data + block_words + 1;
+      v.id_u32s = v.size ? 1 : 0;
+      v.freq_u32s = v.size ? 1 : 0;
+    } else {
+      uint64_t offset = d.data[0] | ((uint64_t)d.data[1] << 32);
+      v.id_u32s = d.data[2] & ~dense_flag;
+      v.dense = (d.data[2] & dense_flag) != 0;
+      v.freq_u32s = d.data[3];
+      v.blocks = (const block_data*)(m_arena.data() + offset);
+      v.id_data = m_arena.data() + offset + v.num_blocks*block_words;
+      v.freq_data = v.id_data + v.id_u32s;
+    }
+    return list_type(v,d.list_max_score,d.max_doc_weight);
+  }
+
+  // lists stored in their descriptor
+  size_t in_place() const { return m_in_place; }
+
+  // lists whose ids are a bitmap
+  size_t dense() const { return m_dense; }
+
+  size_t size_in_bytes() const {
+    return m_lists.size()*sizeof(descriptor) +
+           m_arena.size()*sizeof(uint32_t);
+  }
+
+  size_t advise_huge_pages() const {
+    return ::advise_huge_pages(m_arena.data(),
+                               m_arena.size()*sizeof(uint32_t));
+  }
+};
+
+#endif
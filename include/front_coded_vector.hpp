@@ -0,0 +1,151 @@
+#ifndef FRONT_CODED_VECTOR_HPP
+#define FRONT_CODED_VECTOR_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "vbyte_coder.hpp"
+
+// Immutable array of strings stored with front coding. Strings are grouped
+// in buckets of t_bucket_size; the first string of a bucket is stored in full
+// and each following one as (lcp with its predecessor, suffix). A bucket
+// offset table gives O(1) access to any bucket, so accessing a string decodes
+// at most one bucket. If the strings are sorted, lookup() finds a string by
+// binary search over the bucket heads.
+//
+// The serialized form is position independent and 8-byte aligned, so the
+// vector can be used directly on top of a memory mapped file:
+//   uint64_t n, uint64_t bucket_size, uint64_t data_bytes,
+//   uint64_t bucket_offsets[ceil(n/bucket_size)], uint8_t data[data_bytes],
+//   padding to a multiple of 8 bytes.
+class front_coded_vector {
+public:
+  static const uint64_t not_found = (uint64_t) -1;
+private:
+  uint64_t m_size = 0;
+  uint64_t m_bucket_size = 0;
+  const uint64_t* m_offsets = nullptr;
+  const uint8_t* m_data = nullptr;
+private:
+  static size_t pad8(size_t bytes) { return (bytes + 7) & ~((size_t)7); }
+  size_t num_buckets() const {
+    return m_bucket_size ? (m_size + m_bucket_size - 1) / m_bucket_size : 0;
+  }
+  // head string of bucket b
+  const uint8_t* bucket_head(size_t b,uint32_t& len) const {
+    const uint8_t* in = m_data + m_offsets[b];
+    len = vbyte_coder::decode_num(in);
+    return in;
+  }
+  // decode the string at position i in bucket b, starting at the bucket head
+  void decode(size_t b,size_t i,std::string& str) const {
+    uint32_t len;
+    const uint8_t* in = bucket_head(b,len);
+    str.assign((const char*)in,len);
+    in += len;
+    for (size_t j=0;j<i;j++) {
+      uint32_t lcp = vbyte_coder::decode_num(in);
+      uint32_t suffix = vbyte_coder::decode_num(in);
+      str.resize(lcp);
+      str.append((const char*)in,suffix);
+      in += suffix;
+    }
+  }
+public:
+  front_coded_vector() = default;
+
+  // interpret the serialized vector at data; returns the number of bytes used
+  size_t map(const uint8_t* data) {
+    const uint64_t* header = (const uint64_t*) data;
+    m_size = header[0];
+    m_bucket_size = header[1];
+    uint64_t data_bytes = header[2];
+    m_offsets = header + 3;
+    m_data = (const uint8_t*)(m_offsets + num_buckets());
+    return (m_data - data) + pad8(data_bytes);
+  }
+
+  static void serialize(const std::vector<std::string>& strs,
+                        uint64_t bucket_size,std::ostream& out) {
+    std::vector<uint64_t> offsets;
+    std::vector<uint8_t> data;
+    uint8_t tmp[16];
+    auto append_num = [&](uint32_t x) {
+      size_t n = vbyte_coder::encode_num(x,tmp);
+      data.insert(data.end(),tmp,tmp+n);
+    };
+    for (size_t i=0;i<strs.size();i++) {
+      const auto& s = strs[i];
+      if (i % bucket_size == 0) {
+        offsets.push_back(data.size());
+        append_num(s.size());
+        data.insert(data.end(),s.begin(),s.end());
+      } else {
+        const auto& prev = strs[i-1];
+        size_t lcp = 0;
+        size_t max_lcp = std::min(prev.size(),s.size());
+        while (lcp < max_lcp && prev[lcp] == s[lcp]) lcp++;
+        append_num(lcp);
+        append_num(s.size()-lcp);
+        data.insert(data.end(),s.begin()+lcp,s.end());
+      }
+    }
+    uint64_t header[3] = {strs.size(),bucket_size,data.size()};
+    out.write((const char*)header,sizeof(header));
+    out.write((const char*)offsets.data(),offsets.size()*sizeof(uint64_t));
+    out.write((const char*)data.data(),data.size());
+    static const char padding[8] = {0};
+    out.write(padding,pad8(data.size())-data.size());
+  }
+
+  uint64_t size() const { return m_size; }
+
+  std::string operator[](size_t i) const {
+    std::string str;
+    decode(i / m_bucket_size,i % m_bucket_size,str);
+    return str;
+  }
+
+  // position of str, requires the strings to be sorted
+  uint64_t lookup(const std::string& str) const {
+    if (m_size == 0) return not_found;
+    // last bucket whose head is <= str
+    size_t lo = 0;
+    size_t hi = num_buckets();
+    while (hi - lo > 1) {
+      size_t mid = lo + (hi - lo) / 2;
+      uint32_t len;
+      const uint8_t* head = bucket_head(mid,len);
+      int cmp = memcmp(head,str.data(),std::min<size_t>(len,str.size()));
+      if (cmp < 0 || (cmp == 0 && len <= str.size())) {
+        lo = mid;
+      } else {
+        hi = mid;
+      }
+    }
+    // scan the bucket
+    uint32_t len;
+    const uint8_t* in = bucket_head(lo,len);
+    std::string cur((const char*)in,len);
+    in += len;
+    size_t bucket_end = std::min(m_size,(lo+1)*m_bucket_size);
+    for (size_t i=lo*m_bucket_size;i<bucket_end;i++) {
+      if (i != lo*m_bucket_size) {
+        uint32_t lcp = vbyte_coder::decode_num(in);
+        uint32_t suffix = vbyte_coder::decode_num(in);
+        cur.resize(lcp);
+        cur.append((const char*)in,suffix);
+        in += suffix;
+      }
+      if (cur == str) return i;
+      if (cur > str) break;
+    }
+    return not_found;
+  }
+};
+
+#endif
@@ -0,0 +1,325 @@
+#ifndef IMPACT_INDEX_HPP
+#define IMPACT_INDEX_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <vector>
+
+#include "query.hpp"
+#include "query_budget.hpp"
+#include "query_context.hpp"
+#include "vbyte_coder.hpp"
+#include "mmap_file.hpp"
+#include "sdsl/int_vector.hpp"
+
+// Impact ordered index for score-at-a-time processing (JASS style).
+//
+// Every posting is scored once at construction time and its score is
+// quantized to an integer impact in [1,2^bits-1]. The postings of a term
+// are grouped into segments of equal impact, segments are stored in
+// decreasing impact order and the doc ids within a segment are stored as
+// vbyte coded gaps.
+//
+// A query processes the segments of all its terms in decreasing impact
+// order and adds the impacts to an accumulator per document. Processing
+// may stop after a budget of postings (the anytime property): the highest
+// impacts have been processed first, so the effectiveness loss is small
+// while the latency is bounded by the budget.
+class idx_impact {
+public:
+  using size_type = sdsl::int_vector<>::size_type;
+  static const uint64_t unlimited = std::numeric_limits<uint64_t>::max();
+private:
+  struct segment {
+    uint32_t impact = 0;
+    uint32_t size = 0;      // number of postings
+    uint64_t offset = 0;    // start of the vbyte coded gaps in m_data
+  };
+  // accumulator table with JASS style lazy clearing: the table is split into
+  // pages of 2^page_bits accumulators and a page is zeroed on its first
+  // write of each query
+  struct accumulators {
+    static const uint64_t page_bits = 11;
+    std::vector<uint32_t> values;
+    std::vector<uint8_t> dirty;
+    std::vector<uint64_t> dirty_pages;
+    void resize(uint64_t num_docs) {
+      uint64_t num_pages = (num_docs >> page_bits) + 1;
+      if (dirty.size() != num_pages) {
+        values.assign(num_pages << page_bits,0);
+        dirty.assign(num_pages,0);
+        dirty_pages.clear();
+      }
+    }
+    void clear() {
+      for (const auto& p : dirty_pages) dirty[p] = 0;
+      dirty_pages.clear();
+    }
+    inline void touch(uint64_t doc_id) {
+      uint64_t page = doc_id >> page_bits;
+      if (!dirty[page]) {
+        dirty[page] = 1;
+        dirty_pages.push_back(page);
+        std::fill_n(values.begin()+(page << page_bits),1ULL << page_bits,0);
+      }
+    }
+  };
+public:
+  // buffers of a running query, kept by a search thread across queries
+  struct context {
+    accumulators acc;
+    std::vector<uint32_t> doc_ids;
+    std::vector<std::pair<uint64_t,const segment*>> segments;
+    std::vector<doc_score> heap;
+    result res;
+  };
+private:
+  uint64_t m_num_docs = 0;
+  uint32_t m_bits = 8;
+  double m_max_score = 0;              // score mapped to the largest impact
+  std::vector<uint64_t> m_term_start;  // segments of term t are
+  std::vector<segment> m_segments;     // [m_term_start[t],m_term_start[t+1])
+  std::vector<uint32_t> m_data;
+  uint32_t m_max_segment = 0;
+public:
+  idx_impact() = default;
+
+  // quantize and reorder the postings of a document ordered index
+  template<class t_pl,class t_rank>
+  idx_impact(const std::vector<t_pl>& postings_lists,const t_rank& ranker,
+             uint64_t num_docs,uint32_t bits = 8)
+    : m_num_docs(num_docs), m_bits(bits)
+  {
+    for (const auto& pl : postings_lists) {
+      if (pl.size()) m_max_score = std::max(m_max_score,pl.list_max_score());
+    }
+    uint32_t max_impact = (1U << m_bits) - 1;
+
+    std::vector<uint8_t> bytes;
+    std::map<uint32_t,std::vector<uint32_t>,std::greater<uint32_t>> by_impact;
+    m_term_start.push_back(0);
+    for (const auto& pl : postings_lists) {
+      by_impact.clear();
+      double f_t = pl.size();
+      for (auto itr = pl.begin(); itr != pl.end(); ++itr) {
+        auto doc_id = itr.docid();
+        double W_d = ranker.doc_length(doc_id);
+        double score = ranker.calculate_docscore(1.0,itr.freq(),f_t,W_d,true);
+        by_impact[quantize(score,max_impact)].push_back(doc_id);
+      }
+      for (const auto& seg_ids : by_impact) {
+        segment seg;
+        seg.impact = seg_ids.first;
+        seg.size = seg_ids.second.size();
+        seg.offset = m_data.size();
+        bytes.resize(5*seg.size+4);
+        uint8_t* out = bytes.data();
+        uint32_t prev = 0;
+        for (const auto& id : seg_ids.second) {
+          out += vbyte_coder::encode_num(id-prev,out);
+          prev = id;
+        }
+        size_t written = out - bytes.data();
+        m_data.resize(m_data.size() + (written+3)/4);
+        memcpy(m_data.data()+seg.offset,bytes.data(),written);
+        m_max_segment = std::max(m_max_segment,seg.size);
+        m_segments.push_back(seg);
+      }
+      m_term_start.push_back(m_segments.size());
+    }
+  }
+
+  uint32_t quantize(double score,uint32_t max_impact) const {
+    if (m_max_score <= 0) return 1;
+    uint32_t impact = 1 + (uint32_t)(score / m_max_score * (max_impact-1));
+    return std::min(impact,max_impact);
+  }
+
+  uint64_t num_docs() const { return m_num_docs; }
+
+  size_t advise_huge_pages() const {
+    return ::advise_huge_pages(m_data.data(),m_data.size()*sizeof(uint32_t));
+  }
+
+  // scores are the sums of the quantized impacts; this converts such a sum
+  // back to the approximate scale of the original scores
+  double impact_scale() const {
+    uint32_t max_impact = (1U << m_bits) - 1;
+    return m_max_score / (max_impact-1);
+  }
+
+  // call fn(doc_id,impact) for every posting of term_id, segment by
+  // segment in decreasing order of impact
+  template<class t_fn>
+  void for_each_posting(uint64_t term_id,t_fn fn) const {
+    if (term_id+1 >= m_term_start.size()) return;
+    for (auto s = m_term_start[term_id]; s < m_term_start[term_id+1]; s++) {
+      const auto& seg = m_segments[s];
+      const uint8_t* in = (const uint8_t*)(m_data.data()+seg.offset);
+      uint32_t doc_id = 0;
+      for (size_t i=0;i<seg.size;i++) {
+        doc_id += vbyte_coder::decode_num(in);
+        fn(doc_id,seg.impact);
+      }
+    }
+  }
+
+  // the time limit of budget is checked between segments
+  result& search(context& ctx,const std::vector<query_token>& qry,size_t k,
+                 uint64_t postings_budget = unlimited,bool profile = false,
+                 const query_budget& budget = query_budget()) const
+  {
+    auto& res = ctx.res;
+    auto& acc = ctx.acc;
+    auto& doc_ids = ctx.doc_ids;
+    auto& segments = ctx.segments;
+    res.clear();
+    uint64_t deadline = std::numeric_limits<uint64_t>::max();
+    if (budget.time_us != query_budget::unlimited) {
+      deadline = read_cycle_counter() +
+                 (uint64_t)(budget.time_us * cycles_per_microsecond());
+    }
+    acc.resize(m_num_docs);
+    doc_ids.resize(m_max_segment);
+
+    // Impacts are scaled by the query weights. Should the highest sum of
+    // one scaled impact per term overflow an accumulator, all weights are
+    // scaled down alike, which keeps the ranking; the margin covers the
+    // rounding.
+    double max_sum = 0;
+    for (const auto& qry_token : qry) {
+      auto term_id = qry_token.token_ids[0];
+      if (term_id+1 >= m_term_start.size() ||
+          m_term_start[term_id] == m_term_start[term_id+1]) continue;
+      max_sum += std::max(0.0,m_segments[m_term_start[term_id]].impact *
+                              qry_token.f_qt);
+    }
+    double max_acc = std::numeric_limits<uint32_t>::max() - qry.size();
+    double weight_scale = (max_sum > max_acc) ? max_acc / max_sum : 1.0;
+
+    // all segments of the query in decreasing order of their contribution
+    segments.clear();
+    for (const auto& qry_token : qry) {
+      auto term_id = qry_token.token_ids[0];
+      if (term_id+1 >= m_term_start.size()) continue;
+      for (auto s = m_term_start[term_id]; s < m_term_start[term_id+1]; s++) {
+        double scaled = m_segments[s].impact * qry_token.f_qt * weight_scale;
+        uint64_t impact = std::llround(std::max(0.0,scaled));
+        segments.emplace_back(impact,&m_segments[s]);
+        if (profile) res.postings_total += m_segments[s].size;
+      }
+    }
+    std::sort(segments.begin(),segments.end(),
+      [](const std::pair<uint64_t,const segment*>& a,
+         const std::pair<uint64_t,const segment*>& b) {
+        if (a.first != b.first) return a.first > b.first;
+        return a.second < b.second;
+      });
+
+    uint64_t processed = 0;
+    for (const auto& seg : segments) {
+      if (processed >= postings_budget || read_cycle_counter() >= deadline) {
+        res.score_safe = false;
+        res.budget_stopped = true;
+        break;
+      }
+      uint64_t n = std::min<uint64_t>(seg.second->size,
+                                      postings_budget-processed);
+      uint32_t impact = seg.first;
+      const uint8_t* in = (const uint8_t*)(m_data.data()+seg.second->offset);
+      uint32_t doc_id = 0;
+      for (size_t i=0;i<n;i++) {
+        doc_id += vbyte_coder::decode_num(in);
+        doc_ids[i] = doc_id;
+      }
+      for (size_t i=0;i<n;i++) {
+        acc.touch(doc_ids[i]);
+      }
+      // branch free loop over a whole segment
+      uint32_t* values = acc.values.data();
+      const uint32_t* ids = doc_ids.data();
+      for (size_t i=0;i<n;i++) {
+        values[ids[i]] += impact;
+      }
+      processed += n;
+    }
+    if (profile) res.postings_evaluated = processed;
+
+    // top-k of the touched accumulator pages, in doc id order so that of
+    // documents of equal score the one of the lower id is kept
+    auto& score_heap = ctx.heap;
+    score_heap.clear();
+    std::sort(acc.dirty_pages.begin(),acc.dirty_pages.end());
+    for (const auto& page : acc.dirty_pages) {
+      uint64_t start = page << accumulators::page_bits;
+      uint64_t end = std::min<uint64_t>(start + (1ULL << accumulators::page_bits),
+                              m_num_docs);
+      for (uint64_t d=start;d<end;d++) {
+        uint32_t score = acc.values[d];
+        if (score == 0) continue;
+        push_top_k(score_heap,k,d,score);
+      }
+    }
+    acc.clear();
+
+    top_k_to_list(score_heap,res.list);
+    if (!res.list.empty()) res.final_threshold = res.list.back().score;
+    return res;
+  }
+
+  // same, with a context of the calling thread; the result is handed over
+  result search(const std::vector<query_token>& qry,size_t k,
+                uint64_t postings_budget = unlimited,bool profile = false,
+                const query_budget& budget = query_budget()) const
+  {
+    static thread_local context ctx;
+    return std::move(search(ctx,qry,k,postings_budget,profile,budget));
+  }
+
+  auto serialize(std::ostream& out,
+                 sdsl::structure_tree_node* v=NULL,
+                 std::string name="") const -> size_type {
+    auto* child = sdsl::structure_tree::add_child(v, name,
+                                 sdsl::util::class_name(*this));
+    size_type written_bytes = 0;
+    written_bytes += sdsl::write_member(m_num_docs,out,child,"num docs");
+    written_bytes += sdsl::write_member(m_bits,out,child,"impact bits");
+    written_bytes += sdsl::write_member(m_max_score,out,child,"max score");
+    written_bytes += sdsl::write_member(m_max_segment,out,child,"max segment");
+    uint64_t num_terms = m_term_start.size();
+    uint64_t num_segments = m_segments.size();
+    uint64_t data_u32s = m_data.size();
+    written_bytes += sdsl::write_member(num_terms,out,child,"num terms");
+    written_bytes += sdsl::write_member(num_segments,out,child,"num segments");
+    written_bytes += sdsl::write_member(data_u32s,out,child,"data u32s");
+    out.write((const char*)m_term_start.data(),num_terms*sizeof(uint64_t));
+    out.write((const char*)m_segments.data(),num_segments*sizeof(segment));
+    out.write((const char*)m_data.data(),data_u32s*sizeof(uint32_t));
+    written_bytes += num_terms*sizeof(uint64_t) +
+                     num_segments*sizeof(segment) +
+                     data_u32s*sizeof(uint32_t);
+    sdsl::structure_tree::add_size(child, written_bytes);
+    return written_bytes;
+  }
+
+  void load(std::istream& in) {
+    sdsl::read_member(m_num_docs,in);
+    sdsl::read_member(m_bits,in);
+    sdsl::read_member(m_max_score,in);
+    sdsl::read_member(m_max_segment,in);
+    uint64_t num_terms, num_segments, data_u32s;
+    sdsl::read_member(num_terms,in);
+    sdsl::read_member(num_segments,in);
+    sdsl::read_member(data_u32s,in);
+    m_term_start.resize(num_terms);
+    m_segments.resize(num_segments);
+    m_data.resize(data_u32s);
+    in.read((char*)m_term_start.data(),num_terms*sizeof(uint64_t));
+    in.read((char*)m_segments.data(),num_segments*sizeof(segment));
+    in.read((char*)m_data.data(),data_u32s*sizeof(uint32_t));
+  }
+};
+
+#endif
@@ -0,0 +1,149 @@
+#ifndef INDEX_LOADER_HPP
+#define INDEX_LOADER_HPP
+
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "util.hpp"
+#include "docno_table.hpp"
+#include "impact_index.hpp"
+#include "pareto_bounds.hpp"
+#include "static_pruning.hpp"
+#include "tiered_index.hpp"
+
+// the index files of a collection directory
+struct collection_files {
+  std::string collection_dir;
+  std::string postings_file;
+  std::string F_t_file;
+  std::string df_t_file;
+  std::string doclen_file;
+  std::string global_file;
+  std::string impact_file;
+  std::string pruned_file;          // mk_wand_idx -P/-G
+  std::string pruned_cutoffs_file;
+  std::string pareto_file;
+
+  collection_files() = default;
+  explicit collection_files(const std::string& dir)
+    : collection_dir(dir),
+      postings_file(dir + "/WANDbl_postings.idx"),
+      F_t_file(dir + "/WANDbl_F_t.idx"),
+      df_t_file(dir + "/WANDbl_df_t.idx"),
+      doclen_file(dir + "/doc_lens.txt"),
+      global_file(dir + "/global.txt"),
+      impact_file(dir + "/WANDbl_impact.idx"),
+      pruned_file(dir + "/WANDbl_pruned.idx"),
+      pruned_cutoffs_file(dir + "/WANDbl_pruned_cutoffs.idx"),
+      pareto_file(dir + "/WANDbl_pareto.idx") {}
+};
+
+// load the document at a time index and the document lengths the ranker
+// needs; ranker_args go to the constructor of the ranker
+template<class t_index,class... t_ranker_args>
+void
+load_index(t_index& index,const collection_files& files,
+           t_ranker_args... ranker_args)
+{
+  // Construct index instance.
+  construct(index, files.postings_file, files.F_t_file, files.df_t_file);
+
+  // Get vector of doc lengths and uint64 term count using asc file
+  uint64_t term_count = 0, temp;
+  std::vector<uint64_t>doc_lens;
+  doc_lens.reserve(131072); // Speed up load.
+  std::ifstream doclen_file(files.doclen_file);
+  if(doclen_file.is_open() != true){
+    std::cerr << "Couldn't open: " << files.doclen_file << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  std::cout << "Reading document lengths." << std::endl;
+  /*Read the lengths of each document from asc file into vector*/
+  while(doclen_file >> temp){
+    doc_lens.push_back(temp);
+    term_count += temp;
+  }
+
+  if(files.global_file != "") {
+    std::ifstream global_file(files.global_file);
+    if(global_file.is_open() != true){
+      std::cerr << "Couldn't open: " << files.global_file << std::endl;
+      exit(EXIT_FAILURE);
+    }
+
+    uint64_t total_docs, total_terms;
+    global_file >> total_docs >> total_terms;
+
+    index.load(doc_lens, total_terms, total_docs, ranker_args...);
+  }
+}
+
+// recompute the list maxima of a loaded index for the parameters of its
+// ranker from the Pareto sets of mk_wand_idx
+template<class t_index>
+void
+load_pareto_bounds(t_index& index,const collection_files& files)
+{
+  std::ifstream in(files.pareto_file);
+  if (!in.is_open()) {
+    std::cerr << "Could not open file: " << files.pareto_file << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  pareto_bounds bounds;
+  if (!bounds.load(in) || bounds.size() != index.postings().size()) {
+    std::cerr << files.pareto_file << " does not match the index."
+              << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  std::cout << "Recomputing the list maxima from " << bounds.pairs()
+            << " Pareto pairs." << std::endl;
+  index.set_list_maxima(bounds);
+}
+
+// load the pruned index written by mk_wand_idx -P/-G as the first tier
+// and the full index as the second. Both are read into memory; the full
+// index is neither loaded lazily nor memory mapped, so a tiered index
+// takes the memory of both even if the first tier answers most queries.
+template<class t_index>
+void
+load_tiered_index(tiered_index<t_index>& index,const collection_files& files)
+{
+  collection_files pruned_files = files;
+  pruned_files.postings_file = files.pruned_file;
+  t_index tier, full;
+  load_index(tier,pruned_files);
+  load_index(full,files);
+  auto cutoffs = read_pruning_cutoffs(files.pruned_cutoffs_file);
+  index = tiered_index<t_index>(std::move(tier),std::move(full),
+                                std::move(cutoffs));
+}
+
+// load the impact ordered index written by mk_wand_idx -I
+inline void
+load_impact_index(idx_impact& index,const collection_files& files)
+{
+  std::ifstream ifs(files.impact_file);
+  if (!ifs.is_open()) {
+    std::cerr << "Could not open file: " << files.impact_file << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  index.load(ifs);
+}
+
+inline docno_table
+load_doc_names(const std::string& collection_dir)
+{
+  std::string doc_names_bin_file = collection_dir + "/" + DOCNAMES_BIN_FILENAME;
+  if (file_exists(doc_names_bin_file)) {
+    return docno_table(doc_names_bin_file);
+  }
+  std::cerr << "WARNING: " << doc_names_bin_file << " not found, "
+            << "reading " << DOCNAMES_FILENAME << "." << std::endl;
+  return docno_table::from_text(collection_dir + "/" + DOCNAMES_FILENAME);
+}
+
+#endif
@@ -6,8 +6,12 @@
 #include "sdsl/config.hpp"
 #include "sdsl/int_vector.hpp"
 #include "block_postings_list.hpp"
+#include "shared_block_cache.hpp"
+#include "flat_postings.hpp"
 #include "util.hpp"
 #include "bm25.hpp"
+#include "query_budget.hpp"
+#include "query_context.hpp"
 
 using namespace sdsl;
 
@@ -18,29 +22,11 @@ public:
   using size_type = sdsl::int_vector<>::size_type;
   using plist_type = t_pl;
   using ranker_type = t_rank;
+  using cursors_type = query_cursors<plist_type>;
+  using context_type = query_context<plist_type>;
+  using batch_context_type = batch_context<plist_type>;
 private:
-  // determine lists
-  struct plist_wrapper {
-    typename plist_type::const_iterator cur;
-    typename plist_type::const_iterator end;
-    double f_qt;
-    double f_t;
-    double F_t;
-    double list_max_score;
-    double max_doc_weight;
-    plist_wrapper() = default;
-    plist_wrapper(plist_type& pl,double _F_t,double _f_qt) {
-      cur = pl.begin();
-      end = pl.end();
-      list_max_score = pl.list_max_score();
-      max_doc_weight = pl.max_doc_weight();
-      f_t = pl.size();
-      F_t = _F_t;
-      f_qt = _f_qt;
-    }
-  };
-private:
-  std::vector<plist_type> m_postings_lists;
+  typename plist_type::flat_type m_postings;
   sdsl::int_vector<> m_F_t;
   sdsl::int_vector<> m_f_t;
   ranker_type ranker;
@@ -48,8 +34,8 @@ public:
   idx_invfile() = default;
 
   // Search constructor 
-  idx_invfile(std::string& postings_file, std::string& F_t_file, 
-              std::string& f_t_file)
+  idx_invfile(const std::string& postings_file, const std::string& F_t_file, 
+              const std::string& f_t_file)
   {
     //Load m_F_t
     std::ifstream ifs(F_t_file);
@@ -75,13 +61,21 @@ public:
     }
     size_t num_lists; 
     read_member(num_lists,ifs2);
-    m_postings_lists.resize(num_lists);
-    for (size_t i=0;i<num_lists;i++) {
-      m_postings_lists[i].load(ifs2);
-    }
+    ifs2.seekg(0,std::ios::end);
+    size_t file_bytes = ifs2.tellg();
+    ifs2.seekg(sizeof(num_lists),std::ios::beg);
+    m_postings.load(ifs2,num_lists,file_bytes);
+  }
+
+  // In-memory constructor
+  idx_invfile(std::vector<plist_type>&& postings_lists,
+              sdsl::int_vector<>&& F_t, sdsl::int_vector<>&& f_t)
+    : m_postings(postings_lists), m_F_t(std::move(F_t)),
+      m_f_t(std::move(f_t))
+  {
   }
 
-  auto serialize(std::ostream& out, 
+  auto serialize(std::ostream& out,
                  sdsl::structure_tree_node* v=NULL, 
                  std::string name="") const -> size_type {
 
@@ -90,15 +84,38 @@ public:
     size_type written_bytes = 0;
     written_bytes += m_F_t.serialize(out,child,"F_t");
     written_bytes += m_f_t.serialize(out,child,"f_t");
-    size_t num_lists = m_postings_lists.size();
+    size_t num_lists = m_postings.size();
     written_bytes += sdsl::serialize(num_lists,out,child,"num postings lists");
-    for (const auto& pl : m_postings_lists) {
-      written_bytes += sdsl::serialize(pl,out,child,"postings list");
+    for (size_t t=0;t<num_lists;t++) {
+      written_bytes += sdsl::serialize(m_postings.list(t),out,child,
+                                       "postings list");
     }
     structure_tree::add_size(child, written_bytes);
     return written_bytes;
   }
 
+  // back the postings of long lists with transparent huge pages, returns
+  // the number of bytes advised
+  size_t advise_huge_pages() const {
+    return m_postings.advise_huge_pages();
+  }
+
+  // lists, lists stored in their descriptor and bytes of the postings
+  const typename plist_type::flat_type& postings() const {
+    return m_postings;
+  }
+
+  // replace the list maxima by those that bounds derives for the ranker,
+  // e.g. a pareto_bounds for BM25 parameters other than those of the index
+  template<class t_bounds>
+  void set_list_maxima(const t_bounds& bounds) {
+    for (size_t t=0;t<m_postings.size();t++) {
+      if (m_postings.list(t).size() == 0) continue;
+      m_postings.set_list_max_score(t,bounds.list_max_score(t,ranker,
+                                                            (double)m_f_t[t]));
+    }
+  }
+
   void load(sdsl::cache_config& cc){
     ranker = t_rank(cc);
   }
@@ -107,260 +124,337 @@ public:
     ranker = t_rank(doc_len, terms);
   }
 
-  void load(std::vector<uint64_t> doc_len, uint64_t terms, uint64_t num_docs){
-    ranker = t_rank(doc_len, terms, num_docs);
+  // the ranker takes any further arguments, e.g. the k1 and b of BM25
+  template<class... t_ranker_args>
+  void load(std::vector<uint64_t> doc_len, uint64_t terms, uint64_t num_docs,
+            t_ranker_args... ranker_args){
+    ranker = t_rank(doc_len, terms, num_docs, ranker_args...);
   }
 
-  typename std::vector<plist_wrapper*>::iterator
-  find_shortest_list(std::vector<plist_wrapper*>& postings_lists,
-                     const typename std::vector<plist_wrapper*>::iterator& end,
-                     uint64_t id) 
-  {
-    auto itr = postings_lists.begin();
-    if (itr != end) {
-      size_t smallest = std::numeric_limits<size_t>::max();
-      auto smallest_itr = itr;
-      while (itr != end) {
-        if ((*itr)->cur.remaining() < smallest && (*itr)->cur.docid() != id) {
-          smallest = (*itr)->cur.remaining();
-          smallest_itr = itr;
-        }
-        ++itr;
+  // cursor in [0,end) with the fewest remaining postings that is not at id
+  size_t find_shortest_list(cursors_type& cursors,size_t end,uint64_t id) {
+    size_t smallest = std::numeric_limits<size_t>::max();
+    size_t smallest_pos = 0;
+    for (size_t i=0;i<end;i++) {
+      auto remaining = cursors.state(i).cur.remaining();
+      if (remaining < smallest && cursors.doc_id(i) != id) {
+        smallest = remaining;
+        smallest_pos = i;
       }
-      return smallest_itr;
     }
-    return end;
+    return smallest_pos;
   }
 
-  void sort_list_by_id(std::vector<plist_wrapper*>& plists) {
-    // delete if necessary
-    auto del_itr = plists.begin();
-    while (del_itr != plists.end()) {
-      if ((*del_itr)->cur == (*del_itr)->end) {
-        del_itr = plists.erase(del_itr);
-      } else {
-        del_itr++;
-      }
-    }
-    // sort
-    auto id_sort = [](const plist_wrapper* a,const plist_wrapper* b) {
-      return a->cur.docid() < b->cur.docid();
-    };
-    std::sort(plists.begin(),plists.end(),id_sort);
-  }
-
-  void forward_lists(std::vector<plist_wrapper*>& postings_lists,
-       const typename std::vector<plist_wrapper*>::iterator& pivot_list,
-       uint64_t id) {
+  void forward_lists(cursors_type& cursors,size_t pivot,uint64_t id) {
 
-    auto smallest_itr = find_shortest_list(postings_lists,pivot_list+1,id);
+    auto smallest = find_shortest_list(cursors,pivot,id);
 
     // advance the smallest list to the new id
-    (*smallest_itr)->cur.skip_to_id(id);
-
-    if ((*smallest_itr)->cur == (*smallest_itr)->end) {
-      // list is finished! reorder list by id
-      sort_list_by_id(postings_lists);
-      return;
-    }
+    cursors.skip_to(smallest,id);
 
     // bubble it down!
-    auto next = smallest_itr + 1;
-    auto list_end = postings_lists.end();
-    while (next != list_end && 
-           (*smallest_itr)->cur.docid() > (*next)->cur.docid()) {
-      std::swap(*smallest_itr,*next);
-      smallest_itr = next;
-      next++;
-    }
+    cursors.reposition(smallest);
+    cursors.remove_finished();
   }
 
-  std::pair<typename std::vector<plist_wrapper*>::iterator,double>
-  determine_candidate(std::vector<plist_wrapper*>& postings_lists,
-                      double threshold,size_t initial_lists,bool ranked_and) {
+  // returns the position of the pivot cursor (cursors.size() if there is
+  // none) and the sum of the bounds up to it
+  std::pair<size_t,double>
+  determine_candidate(const cursors_type& cursors,double threshold,
+                      double doc_weight_bound,bool ranked_and) {
+    const uint64_t* doc_ids = cursors.doc_ids();
+    const double* max_scores = cursors.max_scores();
+    size_t n = cursors.size();
 
     if (ranked_and) {
-      auto itr = postings_lists.begin();
-      auto end = postings_lists.end();
       double score = 0.0;
-      while(itr != end) {
-        score += (*itr)->list_max_score;
-        itr++;
+      for (size_t i=0;i<n;i++) {
+        score += max_scores[i];
       }
-      itr = postings_lists.end()-1;
-      return {itr,score};
+      return {n-1,score};
     }
 
     double score = 0.0;
-    double max_doc_weight = std::numeric_limits<double>::lowest();
-    double total_score = 0.0;
-    auto itr = postings_lists.begin();
-    auto end = postings_lists.end();
-    while(itr != end) {
-      score += (*itr)->list_max_score;
-      max_doc_weight = std::max(max_doc_weight,(*itr)->max_doc_weight);
-      total_score = score + (max_doc_weight*initial_lists);
-      if(total_score > threshold) {
+    for (size_t i=0;i<n;i++) {
+      score += max_scores[i];
+      if(score + doc_weight_bound > threshold) {
         // forward to last list equal to pivot
-        auto pivot_id = (*itr)->cur.docid();
-        auto next = itr+1;
-        while(next != end && (*next)->cur.docid() == pivot_id) {
-          itr = next;
-          score += (*itr)->list_max_score;
-          max_doc_weight = std::max(max_doc_weight,(*itr)->max_doc_weight);
-          total_score = score + (max_doc_weight*initial_lists);
-          next++;
+        auto pivot_id = doc_ids[i];
+        while(i+1 < n && doc_ids[i+1] == pivot_id) {
+          i++;
+          score += max_scores[i];
         }
-        return {itr,score};
+        return {i,score};
       }
-      itr++;
     }
-    return {end,score};
+    return {n,score};
   }
 
-  double evaluate_pivot(std::vector<plist_wrapper*>& postings_lists,
-                        std::priority_queue<doc_score,
-                        std::vector<doc_score>,
-                        std::greater<doc_score>>& heap,
+  double evaluate_pivot(cursors_type& cursors,
+                        std::vector<doc_score>& heap,
                         double potential_score,
                         double threshold,
                         size_t initial_lists,
                         size_t k) {
-    auto doc_id = postings_lists[0]->cur.docid();
+    auto doc_id = cursors.doc_id(0);
     double W_d = ranker.doc_length(doc_id);
     double doc_score = initial_lists * ranker.calc_doc_weight(W_d);
     potential_score -= doc_score;
 
-    auto itr = postings_lists.begin();
-    auto end = postings_lists.end();
-    while (itr != end) {
-      if ((*itr)->cur.docid() == doc_id) {
-          double contrib = ranker.calculate_docscore((*itr)->f_qt,
-                                                     (*itr)->cur.freq(),
-                                                     (*itr)->f_t,
-                                                     W_d,
-                                                     true);
-          doc_score += contrib;
-          potential_score += contrib;
-          potential_score -= (*itr)->list_max_score;
-          ++((*itr)->cur); // move to next larger doc_id
-          if (potential_score < threshold) {
-            /* move the other equal ones ahead still! */
-            itr++;
-            while (itr != end && (*itr)->cur != (*itr)->end 
-                              && (*itr)->cur.docid() == doc_id) {
-              ++((*itr)->cur);
-              itr++;
-            }
-            break;
-          }
-        } else {
-          break;
+    size_t i = 0;
+    size_t n = cursors.size();
+    while (i < n && cursors.doc_id(i) == doc_id) {
+      const auto& st = cursors.state(i);
+      double contrib = ranker.posting_score(st.w_qt,st.cur.freq(),doc_id);
+      doc_score += contrib;
+      potential_score += contrib;
+      potential_score -= cursors.max_score(i);
+      cursors.next(i); // move to next larger doc_id
+      i++;
+      if (potential_score < threshold) {
+        /* move the other equal ones ahead still! */
+        while (i < n && cursors.doc_id(i) == doc_id) {
+          cursors.next(i);
+          i++;
         }
-        itr++;
+        break;
       }
+    }
 
-      // add if it is in the top-k
-      if (heap.size() < k) {
-        heap.push({doc_id,doc_score});
-      } else {
-        if (heap.top().score < doc_score) {
-          heap.pop();
-          heap.push({doc_id,doc_score});
-        }
-      }
+    // only the first i lists moved
+    cursors.reorder_advanced(i);
 
-      // resort
-      sort_list_by_id(postings_lists);
+    // add if it is in the top-k
+    return push_top_k(heap,k,doc_id,doc_score);
+  }
 
-      if (heap.size()) {
-        return heap.top().score;
-      }
-      return 0.0f;
+  // bound of the document weights added to every candidate
+  double doc_weight_bound(const cursors_type& cursors) const {
+    double max_doc_weight = std::numeric_limits<double>::lowest();
+    for (size_t t=0;t<cursors.num_terms();t++) {
+      max_doc_weight = std::max(max_doc_weight,
+                                cursors.term(t).max_doc_weight);
+    }
+    return max_doc_weight * cursors.size();
   }
 
+  // the next candidate of a traversal, or none
+  void next_candidate(const cursors_type& cursors,wand_state& ws,
+                      bool ranked_and) {
+    auto pivot_and_score = determine_candidate(cursors,
+                                               ws.threshold_factor *
+                                               ws.threshold,
+                                               ws.weight_bound,
+                                               ranked_and);
+    ws.pivot = std::get<0>(pivot_and_score);
+    ws.potential_score = std::get<1>(pivot_and_score);
+    ws.next_doc_id = (ws.pivot < cursors.size()) ? cursors.doc_id(ws.pivot)
+                                                 : cursors_type::finished;
+  }
 
-  result process_wand(std::vector<plist_wrapper*>& postings_lists,
-                      size_t k,bool ranked_and,bool profile) {
-    result res;
+  void wand_start(context_type& ctx,wand_state& ws,bool ranked_and,
+                  bool profile) {
+    auto& cursors = ctx.cursors;
     // heap containing the top-k docs
-    std::priority_queue<doc_score,std::vector<doc_score>,
-                        std::greater<doc_score>> score_heap;
+    ctx.heap.clear();
 
     if (profile) {
-      for (const auto& pl : postings_lists) {
-        res.postings_total += pl->cur.size();
+      for (size_t i=0;i<cursors.size();i++) {
+        ctx.res.postings_total += cursors.state(i).cur.size();
       }
     }
 
+    if (ws.threshold_factor > 1) ctx.res.score_safe = false;
+
     // init list processing 
-    auto threshold = 0.0f;
-    size_t initial_lists = postings_lists.size();
-    sort_list_by_id(postings_lists);
-    auto pivot_and_score = determine_candidate(postings_lists,
-                                               threshold,
-                                               initial_lists,
-                                               ranked_and);
-    auto pivot_list = std::get<0>(pivot_and_score);
-    auto potential_score = std::get<1>(pivot_and_score);
+    ws.threshold = 0.0;
+    ws.initial_lists = cursors.size();
+    ws.weight_bound = doc_weight_bound(cursors);
+    cursors.sort_by_id();
+    next_candidate(cursors,ws,ranked_and);
+  }
 
-    while (pivot_list != postings_lists.end()) {
-      if (postings_lists[0]->cur.docid() == (*pivot_list)->cur.docid()) {
+  // process the candidates with ids below end_doc_id
+  void wand_advance(context_type& ctx,wand_state& ws,size_t k,
+                    bool ranked_and,bool profile,uint64_t end_doc_id) {
+    auto& cursors = ctx.cursors;
+    auto& res = ctx.res;
+    while (ws.next_doc_id < end_doc_id) {
+      if (ws.deadline.expired()) {
+        res.score_safe = false;
+        res.budget_stopped = true;
+        res.stop_doc_id = cursors.doc_id(0);
+        ws.next_doc_id = cursors_type::finished;
+        return;
+      }
+      if (cursors.doc_id(0) == ws.next_doc_id) {
         if (profile) res.postings_evaluated++;
-          threshold = evaluate_pivot(postings_lists,
-                                     score_heap,
-                                     potential_score,
-                                     threshold,
-                                     initial_lists,
-                                     k);
-        } else {
-          forward_lists(postings_lists,pivot_list-1,(*pivot_list)->cur.docid());
-        }
-        pivot_and_score = determine_candidate(postings_lists,
-                                              threshold,
-                                              initial_lists,
-                                              ranked_and);
-        pivot_list = std::get<0>(pivot_and_score);
-        potential_score = std::get<1>(pivot_and_score);
-
-        if (ranked_and && postings_lists.size() != initial_lists) {
-          break;
-        }
+        ws.threshold = evaluate_pivot(cursors,
+                                      ctx.heap,
+                                      ws.potential_score,
+                                      ws.threshold,
+                                      ws.initial_lists,
+                                      k);
+      } else {
+        forward_lists(cursors,ws.pivot,ws.next_doc_id);
+      }
+      if (ranked_and && cursors.size() != ws.initial_lists) {
+        ws.next_doc_id = cursors_type::finished;
+        return;
+      }
+      next_candidate(cursors,ws,ranked_and);
+    }
+  }
+
+  // MaxScore (Turtle and Flood, 1995). The cursors are ordered by their
+  // bounds, which do not change during a query, so their prefix sums are
+  // computed once. The lists up to the last one whose bound sum is at most
+  // the threshold are non-essential: a document in none of the others can
+  // not enter the top k. Candidates are the documents of the essential
+  // lists, and the non-essential lists are probed for them from the
+  // highest bound down until the candidate can not reach the threshold.
+  // In long queries WAND finds its pivot among the first few cursors and
+  // moves one list per step, each of which passes many cursors on its way
+  // back into the id order; MaxScore moves the lists of a candidate
+  // through a heap of the essential cursors instead.
+  void process_maxscore(context_type& ctx,size_t k,bool profile,
+                        const query_budget& budget) {
+    auto& cursors = ctx.cursors;
+    auto& res = ctx.res;
+    auto& heap = ctx.heap;
+    query_deadline deadline(budget);
+    heap.clear();
+
+    if (profile) {
+      for (size_t i=0;i<cursors.size();i++) {
+        res.postings_total += cursors.state(i).cur.size();
       }
+    }
 
-      // return the top-k results
-      res.list.resize(score_heap.size());
-      for (size_t i=0;i<res.list.size();i++) {
-        auto min = score_heap.top(); score_heap.pop();
-        res.list[res.list.size()-1-i] = min;
+    size_t initial_lists = cursors.size();
+    double weight_bound = doc_weight_bound(cursors);
+    cursors.sort_by_max_score();
+    size_t n = cursors.size();
+    const double* bound_sums = cursors.bound_sums();
+    double threshold = 0.0;
+    // lists are essential against the threshold boosted by the factor,
+    // probes stop against the true one
+    double factor = budget.threshold_factor;
+    if (factor > 1) res.score_safe = false;
+    size_t first_essential = 0;
+    while (first_essential < n &&
+           !(bound_sums[first_essential] + weight_bound > factor*threshold)) {
+      first_essential++;
+    }
+    // the essential cursors in a min heap by doc id, the last cursor first
+    // among those on the same document. The non-essential ones are moved
+    // by the probes and must not be in the heap.
+    auto& essential = ctx.essential;
+    auto later = [&](uint32_t a,uint32_t b) {
+      return cursors.doc_id(a) > cursors.doc_id(b) ||
+             (cursors.doc_id(a) == cursors.doc_id(b) && a < b);
+    };
+    essential.clear();
+    for (size_t i=first_essential;i<n;i++) essential.push_back(i);
+    std::make_heap(essential.begin(),essential.end(),later);
+
+    while (!essential.empty()) {
+      uint64_t doc_id = cursors.doc_id(essential.front());
+      if (doc_id == cursors_type::finished) break;
+      if (deadline.expired()) {
+        res.score_safe = false;
+        res.budget_stopped = true;
+        res.stop_doc_id = doc_id;
+        break;
       }
+      if (profile) res.postings_evaluated++;
+      double W_d = ranker.doc_length(doc_id);
+      double doc_score = initial_lists * ranker.calc_doc_weight(W_d);
+      while (!essential.empty() &&
+             cursors.doc_id(essential.front()) == doc_id) {
+        std::pop_heap(essential.begin(),essential.end(),later);
+        uint32_t i = essential.back();
+        const auto& st = cursors.state(i);
+        doc_score += ranker.posting_score(st.w_qt,st.cur.freq(),doc_id);
+        cursors.next(i);
+        std::push_heap(essential.begin(),essential.end(),later);
+      }
+      for (size_t i=first_essential;i-- > 0;) {
+        if (!(doc_score + bound_sums[i] > threshold)) break;
+        if (cursors.doc_id(i) < doc_id) cursors.skip_to(i,doc_id);
+        if (cursors.doc_id(i) == doc_id) {
+          const auto& st = cursors.state(i);
+          doc_score += ranker.posting_score(st.w_qt,st.cur.freq(),doc_id);
+        }
+      }
+      threshold = push_top_k(heap,k,doc_id,doc_score);
+      size_t old_first_essential = first_essential;
+      while (first_essential < n &&
+             !(bound_sums[first_essential] + weight_bound >
+               factor*threshold)) {
+        first_essential++;
+      }
+      if (first_essential != old_first_essential) {
+        essential.erase(std::remove_if(essential.begin(),essential.end(),
+                          [&](uint32_t i) { return i < first_essential; }),
+                        essential.end());
+        std::make_heap(essential.begin(),essential.end(),later);
+      }
+    }
 
-      return res;
+    // return the top-k results
+    ctx.enter_phase(phase_top_k);
+    top_k_to_list(heap,res.list);
   }
 
-  result process_exhaustive(std::vector<plist_wrapper*>& postings_lists,
-                            size_t k,
-                            bool ranked_and,
-                            bool profile) {
-    result res;
+  void process_wand(context_type& ctx,
+                    size_t k,bool ranked_and,bool profile,
+                    const query_budget& budget) {
+    if (!ranked_and && ctx.cursors.size() > budget.max_wand_terms) {
+      process_maxscore(ctx,k,profile,budget);
+      return;
+    }
+    wand_state ws(budget);
+    wand_start(ctx,ws,ranked_and,profile);
+    wand_advance(ctx,ws,k,ranked_and,profile,cursors_type::finished);
+
+    // return the top-k results
+    ctx.enter_phase(phase_top_k);
+    top_k_to_list(ctx.heap,ctx.res.list);
+  }
+
+  void process_exhaustive(context_type& ctx,
+                          size_t k,
+                          bool ranked_and,
+                          bool profile,
+                          const query_budget& budget) {
+    auto& cursors = ctx.cursors;
+    auto& res = ctx.res;
+    query_deadline deadline(budget);
     // heap containing the top-k docs
-    std::priority_queue<doc_score,std::vector<doc_score>,
-                        std::greater<doc_score>> score_heap;
+    auto& score_heap = ctx.heap;
+    score_heap.clear();
 
     if (profile) {
-      for (const auto& pl : postings_lists) {
-        res.postings_total += pl->cur.size();
+      for (size_t i=0;i<cursors.size();i++) {
+        res.postings_total += cursors.state(i).cur.size();
       }
     }
     // process everything!
     auto threshold = 0.0f;
-    size_t initial_lists = postings_lists.size();
-    sort_list_by_id(postings_lists);
-    while (!postings_lists.empty()) {
+    size_t initial_lists = cursors.size();
+    cursors.sort_by_id();
+    while (!cursors.empty()) {
+      if (deadline.expired()) {
+        res.score_safe = false;
+        res.budget_stopped = true;
+        res.stop_doc_id = cursors.doc_id(0);
+        break;
+      }
       if(ranked_and) {
-        auto last_id = postings_lists.back()->cur.docid();
-        if (postings_lists[0]->cur.docid() == last_id) {
-          threshold = evaluate_pivot(postings_lists,
+        auto last_id = cursors.doc_id(cursors.size()-1);
+        if (cursors.doc_id(0) == last_id) {
+          threshold = evaluate_pivot(cursors,
                                      score_heap,
                                      std::numeric_limits<double>::max(), 
                                      threshold,
@@ -368,12 +462,13 @@ public:
                                      k);
           if (profile) res.postings_evaluated++;
         } else {
-          for (auto& pl : postings_lists) {
-               pl->cur.skip_to_id(last_id);
+          for (size_t i=0;i<cursors.size();i++) {
+               cursors.skip_to(i,last_id);
           }
+          cursors.sort_by_id();
         }
       } else {
-        threshold = evaluate_pivot(postings_lists,
+        threshold = evaluate_pivot(cursors,
                                    score_heap,
                                    std::numeric_limits<double>::max(), 
                                    threshold,
@@ -382,70 +477,208 @@ public:
         if (profile) res.postings_evaluated++;
       }
 
-      sort_list_by_id(postings_lists);
-
-      if (ranked_and && postings_lists.size() != initial_lists) {
+      if (ranked_and && cursors.size() != initial_lists) {
         break;
       }
     }
 
     // return the top-k results
-    res.list.resize(score_heap.size());
-    for (size_t i=0;i<res.list.size();i++) {
-      auto min = score_heap.top(); score_heap.pop();
-      res.list[res.list.size()-1-i] = min;
+    ctx.enter_phase(phase_top_k);
+    top_k_to_list(score_heap,res.list);
+  }
+
+  // open the cursors of the terms of qry in ctx, which is then ready for
+  // process_wand() or process_exhaustive()
+  void start_query(context_type& ctx,const std::vector<query_token>& qry,
+                   bool ignore_low_impact) {
+    ctx.res.clear();
+    auto& cursors = ctx.cursors;
+    cursors.reset(qry.size(),ctx.prefetch_next_block);
+    for (const auto& qry_token : qry) {
+      auto id = qry_token.token_ids[0];
+      cursors.add(m_postings.list(id),(double)m_F_t[id],(double)m_f_t[id],
+                  (double)qry_token.f_qt,ranker);
+    }
+    //Remove lists that have an impact below the score threshold
+    if(ignore_low_impact){
+      cursors.remove_low_bounds(SCORE_THRESHOLD);
     }
+  }
 
-    return res;
+  // Score the documents of docs, sorted by id, as evaluate_pivot() would
+  // with the terms of the query started in ctx. Instead of a traversal
+  // the cursors skip to the documents, in the order the terms are scored.
+  void score_documents(context_type& ctx,std::vector<doc_score>& docs) {
+    auto& cursors = ctx.cursors;
+    size_t initial_lists = cursors.size();
+    cursors.sort_by_max_score();
+    for (auto& doc : docs) {
+      double W_d = ranker.doc_length(doc.doc_id);
+      doc.score = initial_lists * ranker.calc_doc_weight(W_d);
+      for (size_t i=cursors.size();i-- > 0;) {
+        if (cursors.doc_id(i) < doc.doc_id) cursors.skip_to(i,doc.doc_id);
+        if (cursors.doc_id(i) == doc.doc_id) {
+          const auto& st = cursors.state(i);
+          doc.score += ranker.posting_score(st.w_qt,st.cur.freq(),doc.doc_id);
+        }
+      }
+    }
   }
 
-  result search(const std::vector<query_token>& qry,size_t k,
-                bool ranked_and = false,bool profile = false, 
-                bool t_exhaustive = false, bool ignore_low_impact = true) {
+  const ranker_type& get_ranker() const { return ranker; }
 
-    std::vector<plist_wrapper> pl_data(qry.size());
-    std::vector<plist_wrapper*> postings_lists;
-    size_t j=0;
-    for (const auto& qry_token : qry) {
-      pl_data[j++] = plist_wrapper(m_postings_lists[qry_token.token_ids[0]], 
-                     (double)m_F_t[qry_token.token_ids[0]],
-                     (double)qry_token.f_qt);
-      //Remove lists that have an impact below the score threshold
-      if(ignore_low_impact){
-        if (pl_data[j-1].list_max_score > SCORE_THRESHOLD) {
-          postings_lists.emplace_back(&(pl_data[j-1]));
-        }
+  // Runs the query in the buffers of ctx and returns ctx.res. Search
+  // threads keep a context across queries to avoid any allocation.
+  result& search(context_type& ctx,const std::vector<query_token>& qry,
+                 size_t k,bool ranked_and = false,bool profile = false, 
+                 bool t_exhaustive = false, bool ignore_low_impact = true,
+                 const query_budget& budget = query_budget()) {
+
+    if (ctx.phase_counters) ctx.phase_counters->start();
+    start_query(ctx,qry,ignore_low_impact);
+    ctx.enter_phase(phase_traversal);
+    if (t_exhaustive) {
+      process_exhaustive(ctx,k,ranked_and,profile,budget);
+    } else {
+      process_wand(ctx,k,ranked_and,profile,budget);
+    }
+    if (ctx.phase_counters) ctx.phase_counters->stop();
+    return ctx.res;
+  }
+
+  // Runs a batch of WAND queries together; the result of query i is
+  // bctx.res(i) and is the same as that of search(). The lists of terms
+  // occurring in several queries are decoded once per block for all of
+  // them: the traversals advance in lockstep over windows of doc ids, so
+  // they read the same blocks of a shared list at about the same time. By
+  // default a window spans one block of the densest shared list. Queries
+  // that search() runs with MaxScore are run first, one after the other,
+  // still sharing the decoded blocks. Time budgets count from the start of
+  // the batch.
+  void search_batch(batch_context_type& bctx,
+                    const std::vector<const std::vector<query_token>*>& qrys,
+                    size_t k,bool ranked_and = false,bool profile = false,
+                    bool ignore_low_impact = true,
+                    const query_budget& budget = query_budget(),
+                    uint64_t window = 0) {
+    const uint32_t not_shared = plist_type::shared_cache_type::no_slot;
+    size_t n = qrys.size();
+    while (bctx.queries.size() < n) {
+      bctx.queries.emplace_back(new context_type());
+    }
+
+    // share the lists of the terms of more than one query
+    auto& terms = bctx.terms;
+    terms.clear();
+    for (auto qry : qrys) {
+      for (const auto& qry_token : *qry) {
+        terms.emplace_back(qry_token.token_ids[0],not_shared);
+      }
+    }
+    std::sort(terms.begin(),terms.end());
+    bctx.shared.clear(bctx.prefetch_next_block);
+    uint64_t min_span = cursors_type::finished;
+    size_t num_terms = 0;
+    for (size_t i=0;i<terms.size();) {
+      size_t j = i;
+      while (j < terms.size() && terms[j].first == terms[i].first) j++;
+      terms[num_terms] = terms[i];
+      auto pl = m_postings.list(terms[i].first);
+      if (j-i > 1 && pl.size() > 0) {
+        terms[num_terms].second = bctx.shared.add_list(pl,j-i);
+        // doc ids covered by a block of the list
+        uint64_t span = pl.block_rep(pl.num_blocks()-1) / pl.num_blocks();
+        min_span = std::min<uint64_t>(min_span,std::max<uint64_t>(1,span));
+      }
+      num_terms++;
+      i = j;
+    }
+    terms.resize(num_terms);
+    if (window == 0) window = min_span;
+
+    // start all traversals
+    bctx.states.clear();
+    bctx.maxscore_queries.clear();
+    for (size_t q=0;q<n;q++) {
+      auto& ctx = *bctx.queries[q];
+      ctx.res.clear();
+      ctx.cursors.reset(qrys[q]->size(),bctx.prefetch_next_block);
+      for (const auto& qry_token : *qrys[q]) {
+        auto id = qry_token.token_ids[0];
+        auto term = std::lower_bound(terms.begin(),terms.end(),
+                                     std::make_pair(id,(uint32_t)0));
+        bool shared = term->second != not_shared;
+        ctx.cursors.add(m_postings.list(id),(double)m_F_t[id],
+                        (double)m_f_t[id],(double)qry_token.f_qt,ranker,
+                        shared ? &bctx.shared : nullptr,term->second);
+      }
+      if (ignore_low_impact) {
+        ctx.cursors.remove_low_bounds(SCORE_THRESHOLD);
       }
-      else{
-        postings_lists.emplace_back(&(pl_data[j-1]));
+      bctx.states.emplace_back(budget);
+      if (!ranked_and && ctx.cursors.size() > budget.max_wand_terms) {
+        process_maxscore(ctx,k,profile,budget);
+        bctx.states[q].next_doc_id = cursors_type::finished;
+        bctx.maxscore_queries.push_back(q);
+        continue;
       }
+      wand_start(ctx,bctx.states[q],ranked_and,profile);
     }
 
-    // We can not ignore *all* of the low scoring terms, so we must use all.
-    if(postings_lists.size() == 0){
-      for(size_t i = 0; i < pl_data.size(); ++i)
-        postings_lists.emplace_back(&(pl_data[i]));
+    // advance them window by window, skipping windows without candidates
+    while (true) {
+      uint64_t next = cursors_type::finished;
+      for (const auto& ws : bctx.states) {
+        next = std::min(next,ws.next_doc_id);
+      }
+      if (next == cursors_type::finished) break;
+      uint64_t end = cursors_type::finished;
+      if (next / window < (cursors_type::finished - 1) / window) {
+        end = (next / window + 1) * window;
+      }
+      for (size_t q=0;q<n;q++) {
+        wand_advance(*bctx.queries[q],bctx.states[q],k,ranked_and,profile,
+                     end);
+      }
     }
 
-    if (t_exhaustive) {
-      return process_exhaustive(postings_lists,k,ranked_and,profile);
-    } else {
-      return process_wand(postings_lists,k,ranked_and,profile);
+    auto maxscore_q = bctx.maxscore_queries.begin();
+    for (size_t q=0;q<n;q++) {
+      if (maxscore_q != bctx.maxscore_queries.end() && *maxscore_q == q) {
+        maxscore_q++; // has its result already
+        continue;
+      }
+      auto& ctx = *bctx.queries[q];
+      top_k_to_list(ctx.heap,ctx.res.list);
     }
   }
+
+  // same, with a context of the calling thread; the result is handed over
+  result search(const std::vector<query_token>& qry,size_t k,
+                bool ranked_and = false,bool profile = false, 
+                bool t_exhaustive = false, bool ignore_low_impact = true,
+                const query_budget& budget = query_budget()) {
+    static thread_local context_type ctx;
+    return std::move(search(ctx,qry,k,ranked_and,profile,t_exhaustive,
+                            ignore_low_impact,budget));
+  }
 };
 
 // Search
 template<class t_pl,class t_rank>
 void construct(idx_invfile<t_pl,t_rank> &idx,
-               std::string& postings_file, 
-               std::string& F_t_file, std::string& f_t_file)
+               const std::string& postings_file, 
+               const std::string& F_t_file, const std::string& f_t_file)
 {
     using namespace sdsl;
     cout << "construct(idx_invfile)"<< endl;
 
     idx = idx_invfile<t_pl,t_rank>(postings_file, F_t_file, f_t_file);
-    cout << "Done" << endl;
+    const auto& postings = idx.postings();
+    cout << "Done: " << postings.size() << " lists, "
+         << postings.in_place() << " stored in place, "
+         << postings.dense() << " dense, "
+         << postings.size_in_bytes() / (1024*1024) << " MiB" << endl;
 }
 #endif
 
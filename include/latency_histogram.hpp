@@ -0,0 +1,130 @@
+#ifndef LATENCY_HISTOGRAM_HPP
+#define LATENCY_HISTOGRAM_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <vector>
+
+// nearest-rank percentile (p in [0,100]) of an ascending sorted vector
+template<class t_value>
+t_value percentile(const std::vector<t_value>& sorted,double p)
+{
+  if (sorted.empty()) return t_value();
+  size_t rank = (size_t) std::ceil(p / 100.0 * sorted.size());
+  if (rank == 0) rank = 1;
+  return sorted[std::min(rank,sorted.size())-1];
+}
+
+// HdrHistogram-style log-linear histogram. Values are grouped by their most
+// significant bit and every such power-of-two range is split into
+// 2^(t_sub_bits-1) linear sub-buckets, so the relative error of any
+// recorded value is below 2^-(t_sub_bits-1).
+template<uint32_t t_sub_bits = 8>
+class log_linear_histogram {
+  static_assert(t_sub_bits >= 2 && t_sub_bits < 32,"invalid sub bucket bits");
+  static const uint64_t half = 1ULL << (t_sub_bits-1);
+private:
+  std::vector<uint64_t> m_counts;
+  uint64_t m_total = 0;
+  uint64_t m_min = std::numeric_limits<uint64_t>::max();
+  uint64_t m_max = 0;
+  double m_sum = 0;
+  double m_sum_sq = 0;
+private:
+  static size_t bucket_index(uint64_t v) {
+    if (v < (half << 1)) return v;
+    uint32_t msb = 63 - __builtin_clzll(v);
+    uint32_t shift = msb - t_sub_bits + 1;
+    return shift*half + (v >> shift);
+  }
+  // largest value mapped to bucket i
+  static uint64_t highest_equivalent(size_t i) {
+    if (i < (half << 1)) return i;
+    uint64_t shift = i/half - 1;
+    uint64_t sub = half + i%half;
+    return ((sub+1) << shift) - 1;
+  }
+public:
+  log_linear_histogram() : m_counts(bucket_index(
+                           std::numeric_limits<uint64_t>::max())+1,0) {}
+
+  void record(uint64_t v) {
+    m_counts[bucket_index(v)]++;
+    m_total++;
+    m_min = std::min(m_min,v);
+    m_max = std::max(m_max,v);
+    m_sum += v;
+    m_sum_sq += (double)v*(double)v;
+  }
+
+  // add the values recorded by another histogram
+  void merge(const log_linear_histogram& other) {
+    for (size_t i=0;i<m_counts.size();i++) m_counts[i] += other.m_counts[i];
+    m_total += other.m_total;
+    m_min = std::min(m_min,other.m_min);
+    m_max = std::max(m_max,other.m_max);
+    m_sum += other.m_sum;
+    m_sum_sq += other.m_sum_sq;
+  }
+
+  uint64_t count() const { return m_total; }
+  uint64_t min() const { return m_total ? m_min : 0; }
+  uint64_t max() const { return m_max; }
+  double mean() const { return m_total ? m_sum / m_total : 0; }
+  double stddev() const {
+    if (!m_total) return 0;
+    double m = mean();
+    return std::sqrt(std::max(0.0,m_sum_sq / m_total - m*m));
+  }
+
+  uint64_t value_at_percentile(double p) const {
+    uint64_t target = (uint64_t) std::ceil(p / 100.0 * m_total);
+    if (target == 0) target = 1;
+    uint64_t seen = 0;
+    for (size_t i=0;i<m_counts.size();i++) {
+      seen += m_counts[i];
+      if (seen >= target) return std::min(highest_equivalent(i),m_max);
+    }
+    return m_max;
+  }
+
+  // percentile distribution in the text format of HdrHistogram's
+  // outputPercentileDistribution; values are divided by unit_scale
+  void write_percentile_distribution(std::ostream& out,
+                                     double unit_scale) const {
+    out << std::setw(12) << "Value" << " "
+        << std::setw(14) << "Percentile" << " "
+        << std::setw(10) << "TotalCount" << " "
+        << std::setw(14) << "1/(1-Percentile)" << "\n\n";
+    uint64_t seen = 0;
+    out << std::fixed;
+    for (size_t i=0;i<m_counts.size() && seen<m_total;i++) {
+      if (m_counts[i] == 0) continue;
+      seen += m_counts[i];
+      double p = (double)seen / m_total;
+      uint64_t v = std::min(highest_equivalent(i),m_max);
+      out << std::setw(12) << std::setprecision(3) << v / unit_scale << " "
+          << std::setw(14) << std::setprecision(12) << p << " "
+          << std::setw(10) << seen << " ";
+      if (seen < m_total) {
+        out << std::setw(14) << std::setprecision(2) << 1.0/(1.0-p);
+      }
+      out << "\n";
+    }
+    out << std::setprecision(3)
+        << "#[Mean    = " << std::setw(12) << mean() / unit_scale
+        << ", StdDeviation   = " << std::setw(12) << stddev() / unit_scale
+        << "]\n"
+        << "#[Max     = " << std::setw(12) << m_max / unit_scale
+        << ", Total count    = " << std::setw(12) << m_total << "]\n"
+        << "#[Buckets = " << std::setw(12) << m_counts.size() / half - 1
+        << ", SubBuckets     = " << std::setw(12) << (half << 1) << "]\n";
+    out.unsetf(std::ios_base::floatfield);
+  }
+};
+
+#endif
@@ -0,0 +1,95 @@
+#ifndef MMAP_FILE_HPP
+#define MMAP_FILE_HPP
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Ask the kernel to back the 2MB aligned part of [data,data+bytes) with
+// transparent huge pages, which saves TLB misses on large structures that
+// are accessed at random. Returns the number of bytes advised; regions
+// smaller than a huge page are left alone.
+inline size_t
+advise_huge_pages(const void* data,size_t bytes)
+{
+#ifdef MADV_HUGEPAGE
+  const uintptr_t huge_page = 2*1024*1024;
+  uintptr_t start = ((uintptr_t)data + huge_page - 1) & ~(huge_page-1);
+  uintptr_t end = ((uintptr_t)data + bytes) & ~(huge_page-1);
+  if (data == nullptr || end <= start) return 0;
+  if (madvise((void*)start,end-start,MADV_HUGEPAGE) != 0) return 0;
+  return end-start;
+#else
+  return 0;
+#endif
+}
+
+// Read-only memory mapping of a whole file. The mapping lives as long as the
+// object; it can be moved but not copied.
+class mmap_file {
+private:
+  const uint8_t* m_data = nullptr;
+  size_t m_size = 0;
+public:
+  mmap_file() = default;
+  mmap_file(const mmap_file&) = delete;
+  mmap_file& operator=(const mmap_file&) = delete;
+  mmap_file(mmap_file&& other) {
+    *this = std::move(other);
+  }
+  mmap_file& operator=(mmap_file&& other) {
+    if (this != &other) {
+      unmap();
+      m_data = other.m_data;
+      m_size = other.m_size;
+      other.m_data = nullptr;
+      other.m_size = 0;
+    }
+    return *this;
+  }
+  explicit mmap_file(const std::string& file_name) {
+    int fd = open(file_name.c_str(),O_RDONLY);
+    if (fd < 0) {
+      std::cerr << "Could not open file: " << file_name << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    struct stat sb;
+    if (fstat(fd,&sb) != 0) {
+      perror("could not stat file");
+      exit(EXIT_FAILURE);
+    }
+    m_size = sb.st_size;
+    if (m_size > 0) {
+      void* addr = mmap(NULL,m_size,PROT_READ,MAP_SHARED,fd,0);
+      if (addr == MAP_FAILED) {
+        perror("could not mmap file");
+        exit(EXIT_FAILURE);
+      }
+      m_data = (const uint8_t*) addr;
+    }
+    close(fd);
+  }
+  ~mmap_file() {
+    unmap();
+  }
+  const uint8_t* data() const { return m_data; }
+  size_t size() const { return m_size; }
+  void advise(int advice) const {
+    if (m_data) madvise((void*)m_data,m_size,advice);
+  }
+private:
+  void unmap() {
+    if (m_data) munmap((void*)m_data,m_size);
+    m_data = nullptr;
+    m_size = 0;
+  }
+};
+
+#endif
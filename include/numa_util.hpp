@@ -0,0 +1,127 @@
+#ifndef NUMA_UTIL_HPP
+#define NUMA_UTIL_HPP
+
+#include <algorithm>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <pthread.h>
+#include <sched.h>
+
+// parse a sysfs cpu or node list such as "0-3,8-11"
+inline std::vector<int>
+parse_cpu_list(const std::string& list)
+{
+  std::vector<int> ids;
+  std::stringstream ss(list);
+  std::string range;
+  while (std::getline(ss,range,',')) {
+    if (range.empty() || range == "\n") continue;
+    auto dash = range.find('-');
+    try {
+      int first = std::stoi(range.substr(0,dash));
+      int last = (dash == std::string::npos) ? first
+                                             : std::stoi(range.substr(dash+1));
+      for (int id=first;id<=last;id++) ids.push_back(id);
+    } catch (const std::exception&) {
+      // ignore what we do not understand
+    }
+  }
+  return ids;
+}
+
+// CPUs of each NUMA node
+struct numa_topology {
+  std::vector<std::vector<int>> node_cpus;
+  bool simulated = false;
+
+  size_t num_nodes() const { return node_cpus.size(); }
+
+  // the node a worker thread is assigned to
+  size_t node_of_worker(size_t worker) const { return worker % num_nodes(); }
+
+  // the nodes of the machine as listed in sysfs; a single node with all
+  // CPUs if there is no NUMA information
+  static numa_topology detect() {
+    numa_topology topo;
+    const std::string sysfs = "/sys/devices/system/node/";
+    std::ifstream online_fs(sysfs + "online");
+    std::string online;
+    if (std::getline(online_fs,online)) {
+      for (auto node : parse_cpu_list(online)) {
+        std::ifstream cpus_fs(sysfs + "node" + std::to_string(node) +
+                              "/cpulist");
+        std::string cpus;
+        if (std::getline(cpus_fs,cpus)) {
+          auto ids = parse_cpu_list(cpus);
+          if (!ids.empty()) topo.node_cpus.push_back(ids);
+        }
+      }
+    }
+    if (topo.node_cpus.empty()) {
+      std::vector<int> all;
+      for (unsigned i=0;i<std::max(1U,std::thread::hardware_concurrency());i++) {
+        all.push_back(i);
+      }
+      topo.node_cpus.push_back(all);
+    }
+    return topo;
+  }
+
+  // n nodes made of consecutive CPUs of the machine. Memory is not
+  // actually local to them; this exercises the replica per node code
+  // paths on machines with a single node.
+  static numa_topology simulate(size_t n) {
+    std::vector<int> all;
+    for (const auto& cpus : detect().node_cpus) {
+      all.insert(all.end(),cpus.begin(),cpus.end());
+    }
+    numa_topology topo;
+    topo.simulated = true;
+    n = std::max<size_t>(1,n);
+    for (size_t i=0;i<n;i++) {
+      std::vector<int> cpus(all.begin() + i*all.size()/n,
+                            all.begin() + (i+1)*all.size()/n);
+      if (cpus.empty()) cpus.push_back(all[i % all.size()]);
+      topo.node_cpus.push_back(cpus);
+    }
+    return topo;
+  }
+};
+
+// restrict the calling thread to the given CPUs
+inline bool
+pin_thread_to_cpus(const std::vector<int>& cpus)
+{
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (auto cpu : cpus) {
+    if (cpu >= 0 && cpu < CPU_SETSIZE) CPU_SET(cpu,&set);
+  }
+  return pthread_setaffinity_np(pthread_self(),sizeof(set),&set) == 0;
+}
+
+// Copy a read-only structure once per node. Each copy is made by a thread
+// pinned to the CPUs of its node, so under the default first touch policy
+// its memory is allocated on that node.
+template<class T>
+std::vector<std::unique_ptr<T>>
+replicate_per_node(const T& master,const numa_topology& topo)
+{
+  std::vector<std::unique_ptr<T>> replicas(topo.num_nodes());
+  std::vector<std::thread> threads;
+  for (size_t node=0;node<topo.num_nodes();node++) {
+    threads.emplace_back([&,node]() {
+      pin_thread_to_cpus(topo.node_cpus[node]);
+      replicas[node].reset(new T(master));
+    });
+  }
+  for (auto& t : threads) t.join();
+  return replicas;
+}
+
+#endif
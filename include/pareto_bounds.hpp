@@ -0,0 +1,117 @@
+#ifndef PARETO_BOUNDS_HPP
+#define PARETO_BOUNDS_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <istream>
+#include <limits>
+#include <ostream>
+#include <utility>
+#include <vector>
+
+#include "sdsl/io.hpp"
+
+// Score bounds of the lists for any BM25 parameters. The tf part of BM25,
+//   (k1+1) f_dt / (k1 ((1-b) + b W_d/avg_W_d) + f_dt),
+// grows with f_dt and does not grow with the document length W_d for all
+// k1 >= 0 and 0 <= b <= 1. The highest scoring posting of a list is thus
+// one that no other posting beats in both, with a higher f_dt and a lower
+// W_d. These (f_dt,W_d) pairs, the Pareto set of the list, are few: at
+// most one per distinct f_dt. mk_wand_idx writes them for every list, and
+// the list maxima of any k1 and b are the highest scores of the pairs,
+// which are exact, so bounds are as tight as those of an index built for
+// these parameters.
+class pareto_bounds {
+public:
+  // (f_dt,W_d) pairs by decreasing f_dt and increasing W_d
+  using pareto_set = std::vector<std::pair<uint32_t,uint32_t>>;
+private:
+  // the pairs of list t are [m_offsets[t],m_offsets[t+1])
+  std::vector<uint64_t> m_offsets = {0};
+  std::vector<uint32_t> m_freqs;
+  std::vector<uint32_t> m_lengths;
+public:
+  pareto_bounds() = default;
+
+  // the Pareto sets of all lists, by term id
+  explicit pareto_bounds(const std::vector<pareto_set>& sets) {
+    for (const auto& set : sets) {
+      for (const auto& p : set) {
+        m_freqs.push_back(p.first);
+        m_lengths.push_back(p.second);
+      }
+      m_offsets.push_back(m_freqs.size());
+    }
+  }
+
+  // the Pareto set of a list of (doc id,f_dt) pairs, as block_postings_list
+  // takes them
+  static pareto_set
+  make_set(const std::vector<std::pair<uint64_t,uint64_t>>& post,
+           const std::vector<uint64_t>& doc_lengths) {
+    pareto_set pairs;
+    pairs.reserve(post.size());
+    for (const auto& p : post) {
+      pairs.emplace_back(p.second,doc_lengths[p.first]);
+    }
+    std::sort(pairs.begin(),pairs.end(),
+              [](const std::pair<uint32_t,uint32_t>& a,
+                 const std::pair<uint32_t,uint32_t>& b) {
+                return a.first > b.first ||
+                       (a.first == b.first && a.second < b.second);
+              });
+    pareto_set set;
+    uint64_t min_length = std::numeric_limits<uint64_t>::max();
+    for (const auto& p : pairs) {
+      if (p.second >= min_length) continue;
+      min_length = p.second;
+      set.push_back(p);
+    }
+    return set;
+  }
+
+  size_t size() const { return m_offsets.size() - 1; }
+
+  // pairs of all lists
+  size_t pairs() const { return m_freqs.size(); }
+
+  // the highest score for f_qt = 1 of a posting of list t with f_t
+  // postings, as block_postings_list computes it from all postings
+  template<class t_rank>
+  double list_max_score(size_t t,const t_rank& ranker,double f_t) const {
+    double max_score = std::numeric_limits<double>::lowest();
+    for (uint64_t i=m_offsets[t];i<m_offsets[t+1];i++) {
+      max_score = std::max(max_score,
+                           ranker.calculate_docscore(1.0,m_freqs[i],f_t,
+                                                     m_lengths[i],true));
+    }
+    return max_score;
+  }
+
+  void serialize(std::ostream& out) const {
+    uint64_t num_lists = size();
+    uint64_t num_pairs = pairs();
+    sdsl::write_member(num_lists,out);
+    sdsl::write_member(num_pairs,out);
+    out.write((const char*)m_offsets.data(),m_offsets.size()*sizeof(uint64_t));
+    out.write((const char*)m_freqs.data(),num_pairs*sizeof(uint32_t));
+    out.write((const char*)m_lengths.data(),num_pairs*sizeof(uint32_t));
+  }
+
+  // returns false if in is truncated
+  bool load(std::istream& in) {
+    uint64_t num_lists = 0, num_pairs = 0;
+    sdsl::read_member(num_lists,in);
+    sdsl::read_member(num_pairs,in);
+    if (!in) return false;
+    m_offsets.resize(num_lists+1);
+    m_freqs.resize(num_pairs);
+    m_lengths.resize(num_pairs);
+    in.read((char*)m_offsets.data(),m_offsets.size()*sizeof(uint64_t));
+    in.read((char*)m_freqs.data(),num_pairs*sizeof(uint32_t));
+    in.read((char*)m_lengths.data(),num_pairs*sizeof(uint32_t));
+    return (bool)in && m_offsets.back() == num_pairs;
+  }
+};
+
+#endif
@@ -0,0 +1,217 @@
+#ifndef PERF_COUNTERS_HPP
+#define PERF_COUNTERS_HPP
+
+#include <array>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <string>
+#include <utility>
+
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// the hardware events counted per query
+enum perf_event_id {
+  perf_cycles,
+  perf_instructions,
+  perf_llc_misses,
+  perf_branch_misses,
+  perf_dtlb_misses,
+  num_perf_events
+};
+
+inline const char*
+perf_event_name(size_t e)
+{
+  static const char* names[num_perf_events] = {
+    "cycles","instructions","llc_misses","branch_misses","dtlb_misses"
+  };
+  return names[e];
+}
+
+// Counts of the events over some interval. An event the machine or the
+// kernel does not count is not valid and written as NA.
+struct perf_values {
+  std::array<double,num_perf_events> count{};
+  std::array<bool,num_perf_events> valid{};
+
+  void clear() {
+    count.fill(0);
+    valid.fill(false);
+  }
+  perf_values& operator+=(const perf_values& other) {
+    for (size_t e=0;e<num_perf_events;e++) {
+      count[e] += other.count[e];
+      valid[e] = valid[e] || other.valid[e];
+    }
+    return *this;
+  }
+  perf_values operator-(const perf_values& other) const {
+    perf_values diff;
+    for (size_t e=0;e<num_perf_events;e++) {
+      diff.count[e] = count[e] - other.count[e];
+      diff.valid[e] = valid[e] && other.valid[e];
+    }
+    return diff;
+  }
+  perf_values& operator/=(double n) {
+    for (auto& c : count) c /= n;
+    return *this;
+  }
+
+  // one column per event, each followed by ';' as the timing log does
+  static void write_header(std::ostream& os,const std::string& prefix) {
+    for (size_t e=0;e<num_perf_events;e++) {
+      os << prefix << perf_event_name(e) << ";";
+    }
+  }
+  void write(std::ostream& os) const {
+    for (size_t e=0;e<num_perf_events;e++) {
+      os << ";";
+      if (valid[e]) os << (uint64_t)count[e];
+      else os << "NA";
+    }
+  }
+};
+
+// Hardware performance counters of the calling thread, opened with
+// perf_event_open(2) as one group so that all events count over the same
+// intervals. Only user space is counted, which perf_event_paranoid <= 2
+// allows to unprivileged users. Counters that cannot be opened (no PMU in
+// a virtual machine or container, paranoid = 3, an event the CPU lacks)
+// are left out; if the cycle counter cannot be opened none are available
+// and error() says why. The counters run from construction on and are
+// read, not reset, so intervals are differences of two reads.
+class perf_counters {
+  int m_fds[num_perf_events];
+  int m_slot[num_perf_events]; // position in the group read, -1 if closed
+  size_t m_num_open = 0;
+  std::string m_error;
+
+  static int open_event(uint32_t type,uint64_t config,int group_fd) {
+    perf_event_attr attr;
+    memset(&attr,0,sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+                       PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return syscall(__NR_perf_event_open,&attr,0,-1,group_fd,0);
+  }
+public:
+  perf_counters() {
+    static const std::pair<uint32_t,uint64_t> events[num_perf_events] = {
+      {PERF_TYPE_HARDWARE,PERF_COUNT_HW_CPU_CYCLES},
+      {PERF_TYPE_HARDWARE,PERF_COUNT_HW_INSTRUCTIONS},
+      {PERF_TYPE_HARDWARE,PERF_COUNT_HW_CACHE_MISSES},
+      {PERF_TYPE_HARDWARE,PERF_COUNT_HW_BRANCH_MISSES},
+      {PERF_TYPE_HW_CACHE,PERF_COUNT_HW_CACHE_DTLB |
+                          (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                          (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)}
+    };
+    for (size_t e=0;e<num_perf_events;e++) {
+      m_fds[e] = -1;
+      m_slot[e] = -1;
+    }
+    for (size_t e=0;e<num_perf_events;e++) {
+      int fd = open_event(events[e].first,events[e].second,
+                          e == perf_cycles ? -1 : m_fds[perf_cycles]);
+      if (fd < 0) {
+        if (e == perf_cycles) {
+          m_error = std::string("perf_event_open: ") + strerror(errno);
+          return;
+        }
+        continue;
+      }
+      m_fds[e] = fd;
+      m_slot[e] = m_num_open++;
+    }
+  }
+  ~perf_counters() {
+    for (auto fd : m_fds) {
+      if (fd >= 0) close(fd);
+    }
+  }
+  perf_counters(const perf_counters&) = delete;
+  perf_counters& operator=(const perf_counters&) = delete;
+
+  bool available() const { return m_fds[perf_cycles] >= 0; }
+  bool counts(perf_event_id e) const { return m_fds[e] >= 0; }
+  const std::string& error() const { return m_error; }
+
+  // the counts since construction, scaled up if the kernel had to share
+  // the counters with other groups; nothing is valid if the group has not
+  // been scheduled at all
+  void read(perf_values& values) const {
+    values.clear();
+    if (!available()) return;
+    uint64_t buf[3+num_perf_events];
+    ssize_t bytes = ::read(m_fds[perf_cycles],buf,sizeof(buf));
+    if (bytes < (ssize_t)(3*sizeof(uint64_t)) || buf[0] != m_num_open ||
+        buf[2] == 0) {
+      return;
+    }
+    double scale = (double)buf[1] / (double)buf[2];
+    for (size_t e=0;e<num_perf_events;e++) {
+      if (m_slot[e] < 0) continue;
+      values.count[e] = buf[3+m_slot[e]] * scale;
+      values.valid[e] = true;
+    }
+  }
+};
+
+// the phases of a document at a time query
+enum query_phase {
+  phase_setup,     // looking up the lists and opening the cursors
+  phase_traversal, // WAND, MaxScore or exhaustive evaluation
+  phase_top_k,     // sorting the heap into the result list
+  num_query_phases
+};
+
+inline const char*
+query_phase_name(size_t p)
+{
+  static const char* names[num_query_phases] = {
+    "setup","traversal","top_k"
+  };
+  return names[p];
+}
+
+// The counts of each phase of the last query. A search reads the counters
+// at the phase boundaries through query_context::enter_phase(). The reads
+// are system calls, which are not counted as only user space is.
+struct query_phase_counters {
+  const perf_counters* counters = nullptr;
+  std::array<perf_values,num_query_phases> phases;
+  bool recorded = false; // the last query went through the phases
+  int current = -1;
+  perf_values last;
+
+  void clear() {
+    for (auto& p : phases) p.clear();
+    recorded = false;
+    current = -1;
+  }
+  void start() {
+    clear();
+    recorded = true;
+    current = phase_setup;
+    counters->read(last);
+  }
+  void enter(int p) {
+    if (current < 0) return;
+    perf_values now;
+    counters->read(now);
+    phases[current] += now - last;
+    last = now;
+    current = p;
+  }
+  void stop() { enter(-1); }
+};
+
+#endif
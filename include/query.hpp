@@ -1,6 +1,8 @@
 #ifndef QUERY_HPP
 #define QUERY_HPP
 
+#include <cstdlib>
+#include <tuple>
 #include <vector>
 #include <iostream>
 #include <fstream>
@@ -9,14 +11,16 @@
 #include <algorithm>
 
 #include "util.hpp"
+#include "term_dictionary.hpp"
 
 
 struct doc_score {
 	uint64_t doc_id;
 	double score;
+  // ties go to the lower doc id, which a traversal finds first and keeps
   bool operator>(const doc_score& rhs) const {
   	if(score == rhs.score)
-    	return doc_id > rhs.doc_id;
+    	return doc_id < rhs.doc_id;
       return score > rhs.score;
     }
   doc_score() {};
@@ -32,15 +36,41 @@ struct result {
   uint64_t docs_fully_evaluated = 0;
   uint64_t docs_added_to_heap = 0;
   double final_threshold = 0;
+  // false if the search stopped at its budget or ran with a threshold
+  // factor > 1
+  bool score_safe = true;
+  // set if the search stopped at its budget; a document at a time search
+  // then processed the documents with ids below stop_doc_id fully and the
+  // others not at all
+  bool budget_stopped = false;
+  uint64_t stop_doc_id = 0;
+  // answered by the first tier of a tiered_index without the full index
+  bool first_tier = false;
+
+  // results own their list and are moved, not copied
+  result() = default;
+  result(result&&) = default;
+  result& operator=(result&&) = default;
+  result(const result&) = delete;
+  result& operator=(const result&) = delete;
+
+  // reset for the next query, keeping the capacity of the list
+  void clear() {
+    std::vector<doc_score> kept;
+    kept.swap(list);
+    *this = result();
+    kept.clear();
+    list.swap(kept);
+  }
 };
 
 struct query_token{
     std::vector<uint64_t> token_ids;
     std::vector<std::string> token_strs;
-	uint64_t f_qt;
+	double f_qt; // number of occurrences or the sum of the term weights
 	query_token(const std::vector<uint64_t>& ids,
               const std::vector<std::string>& strs,
-              uint64_t f) : token_ids(ids), token_strs(strs), f_qt(f) 
+              double f) : token_ids(ids), token_strs(strs), f_qt(f) 
     {
     }
     bool operator<(const query_token& qt) const {
@@ -56,37 +86,44 @@ using query_t = std::tuple<uint64_t,std::vector<query_token>>;
 
 struct query_parser {
     query_parser() = delete;
-    using mapping_t = std::pair<std::unordered_map<std::string,uint64_t>,
-                     std::unordered_map<uint64_t,std::string>
-                     >;
+    using mapping_t = term_dictionary;
 
     static mapping_t
          load_dictionary(const std::string& collection_dir)
     {
-        std::unordered_map<std::string,uint64_t> id_mapping;
-        std::unordered_map<uint64_t,std::string> reverse_id_mapping;
-        {
-            auto dict_file = collection_dir + "/" + DICT_FILENAME;
-            std::ifstream dfs(dict_file);
-            if(!dfs.is_open()) {
-                std::cerr << "cannot load dictionary file.";
-                exit(EXIT_FAILURE);
-            }
-            std::string term_mapping;
-            while( std::getline(dfs,term_mapping) ) {
-                auto sep_pos = term_mapping.find(' ');
-                auto term = term_mapping.substr(0,sep_pos);
-                auto idstr = term_mapping.substr(sep_pos+1);
-                uint64_t id = std::stoull(idstr);
-                id_mapping[term] = id;
-                reverse_id_mapping[id] = term;
-            }
+        auto dict_bin_file = collection_dir + "/" + DICT_BIN_FILENAME;
+        if(file_exists(dict_bin_file)) {
+            return term_dictionary(dict_bin_file);
         }
-        return {id_mapping,reverse_id_mapping};
+        std::cerr << "WARNING: " << dict_bin_file << " not found, "
+                  << "building the dictionary from "
+                  << DICT_FILENAME << "." << std::endl;
+        return term_dictionary::from_text(collection_dir + "/" + DICT_FILENAME);
     }
 
-    static std::tuple<bool,uint64_t,std::vector<uint64_t>> 
-        map_to_ids(const std::unordered_map<std::string,uint64_t>& id_mapping,
+    // a token "term:weight" is the term with the given weight, unless the
+    // whole token is a term of the dictionary; other tokens weigh 1
+    static std::pair<std::string,double>
+        split_weight(const mapping_t& mapping,const std::string& qry_token)
+    {
+        auto sep_pos = qry_token.rfind(':');
+        if(sep_pos == std::string::npos || sep_pos == 0 ||
+           sep_pos + 1 == qry_token.size() || mapping.find(qry_token).first) {
+            return {qry_token,1.0};
+        }
+        const char* weight_str = qry_token.c_str() + sep_pos + 1;
+        char* end = nullptr;
+        double weight = std::strtod(weight_str,&end);
+        if(*end != '\0') {
+            return {qry_token,1.0};
+        }
+        return {qry_token.substr(0,sep_pos),weight};
+    }
+
+    using mapped_token_t = std::tuple<uint64_t,std::string,double>;
+
+    static std::tuple<bool,uint64_t,std::vector<mapped_token_t>>
+        map_to_ids(const mapping_t& mapping,
                    std::string query_str,bool only_complete,bool integers)
     {
         auto id_sep_pos = query_str.find(';');
@@ -94,19 +131,25 @@ struct query_parser {
         auto qry_id = std::stoull(qryid_str);
         auto qry_content = query_str.substr(id_sep_pos+1);
 
-        std::vector<uint64_t> ids;
+        std::vector<mapped_token_t> ids;
         std::istringstream qry_content_stream(qry_content);
         for(std::string qry_token; std::getline(qry_content_stream,qry_token,' ');) {
+            auto weighted = split_weight(mapping,qry_token);
+            const auto& term = weighted.first;
+            if(weighted.second <= 0) {
+                continue; // a term of weight 0 does not change the scores
+            }
             if(integers) {
-                uint64_t id = std::stoull(qry_token);
-                ids.push_back(id);
+                uint64_t id = std::stoull(term);
+                // only integer queries need the id -> term direction
+                ids.emplace_back(id,mapping.term(id).second,weighted.second);
             } else {
-                auto id_itr = id_mapping.find(qry_token);
-                if(id_itr != id_mapping.end()) {
-                    ids.push_back(id_itr->second);
+                auto id_itr = mapping.find(term);
+                if(id_itr.first) {
+                    ids.emplace_back(id_itr.second,term,weighted.second);
                 } else {
                     std::cerr << "ERROR: could not find '" 
-                              << qry_token << "' in the dictionary." 
+                              << term << "' in the dictionary." 
                               << std::endl;
                     if(only_complete) {
                         return std::make_tuple(false,qry_id,ids);
@@ -120,28 +163,25 @@ struct query_parser {
     static std::pair<bool,query_t> parse_query(const mapping_t& mapping,
                 const std::string& query_str,bool only_complete = false,bool integers = false)
     {
-
-        const auto& id_mapping = mapping.first;
-        const auto& reverse_mapping = mapping.second;
-
-        auto mapped_qry = map_to_ids(id_mapping,query_str,only_complete,integers);
+        auto mapped_qry = map_to_ids(mapping,query_str,only_complete,integers);
 
         bool parse_ok = std::get<0>(mapped_qry);
         auto qry_id = std::get<1>(mapped_qry);
         if(parse_ok) {
-            std::unordered_map<uint64_t,uint64_t> qry_set;
+            std::unordered_map<uint64_t,double> qry_set;
+            std::unordered_map<uint64_t,std::string> qry_strs;
             const auto& qids = std::get<2>(mapped_qry);
             for(const auto& qid : qids) {
-                qry_set[qid] += 1;
+                qry_set[std::get<0>(qid)] += std::get<2>(qid);
+                qry_strs[std::get<0>(qid)] = std::get<1>(qid);
             }
             std::vector<query_token> query_tokens;
             for(const auto& qry_tok : qry_set) {
                 std::vector<uint64_t> term;
                 term.push_back(qry_tok.first);
-                auto rmitr = reverse_mapping.find(qry_tok.first);
                 std::vector<std::string> term_str;
-                if(rmitr != reverse_mapping.end()) {
-                    std::string qry_str = rmitr->second;
+                const auto& qry_str = qry_strs[qry_tok.first];
+                if(!qry_str.empty()) {
                     term_str.push_back(qry_str);
                 }
                 query_tokens.emplace_back(term,term_str,qry_tok.second);
@@ -0,0 +1,89 @@
+#ifndef QUERY_BUDGET_HPP
+#define QUERY_BUDGET_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <limits>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// cheap monotonic tick counter: the TSC on x86, the steady clock elsewhere
+inline uint64_t read_cycle_counter() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+           std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+// ticks of read_cycle_counter() per microsecond, measured once against the
+// steady clock (the TSC of current CPUs runs at a constant rate)
+inline double cycles_per_microsecond() {
+  static const double cycles_per_us = []() {
+    using clock = std::chrono::steady_clock;
+    auto start = clock::now();
+    uint64_t start_cycles = read_cycle_counter();
+    while (clock::now() - start < std::chrono::milliseconds(20)) { }
+    uint64_t cycles = read_cycle_counter() - start_cycles;
+    auto us = std::chrono::duration_cast<std::chrono::microseconds>(
+                clock::now() - start).count();
+    return (double)cycles / (double)us;
+  }();
+  return cycles_per_us;
+}
+
+// Per query budget of a search. A query that exceeds either limit stops
+// and returns the documents found so far; its result is then not score
+// safe (see result::score_safe and result::budget_stopped).
+//
+// A threshold factor F > 1 makes WAND and MaxScore select candidates
+// against F times the score of the k-th best document so far (Broder et
+// al., CIKM 2003), which skips more documents at the risk of missing some
+// of the top k. Candidates are still scored fully, so the scores of the
+// documents returned are exact, but the result is not score safe.
+//
+// Disjunctive queries of more than max_wand_terms terms are processed
+// with MaxScore instead of WAND; both are score safe.
+struct query_budget {
+  static const uint64_t unlimited = std::numeric_limits<uint64_t>::max();
+  uint64_t time_us = unlimited;     // wall clock time
+  uint64_t max_pivots = unlimited;  // pivot selections of the traversal
+  double threshold_factor = 1.0;
+  size_t max_wand_terms = 16;
+  bool limited() const {
+    return time_us != unlimited || max_pivots != unlimited;
+  }
+};
+
+// Tracks the budget of one running query. expired() is called once per
+// pivot; the clock is only read every check_interval pivots so the check
+// costs a decrement and a branch in the common case.
+class query_deadline {
+public:
+  static const uint32_t check_interval = 64;
+private:
+  uint64_t m_deadline = std::numeric_limits<uint64_t>::max();
+  uint64_t m_pivots_left;
+  uint32_t m_countdown = check_interval;
+public:
+  explicit query_deadline(const query_budget& budget)
+    : m_pivots_left(budget.max_pivots)
+  {
+    if (budget.time_us != query_budget::unlimited) {
+      m_deadline = read_cycle_counter() +
+                   (uint64_t)(budget.time_us * cycles_per_microsecond());
+    }
+  }
+
+  inline bool expired() {
+    if (m_pivots_left-- == 0) return true;
+    if (--m_countdown != 0) return false;
+    m_countdown = check_interval;
+    return read_cycle_counter() >= m_deadline;
+  }
+};
+
+#endif
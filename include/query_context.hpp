@@ -0,0 +1,97 @@
+#ifndef QUERY_CONTEXT_HPP
+#define QUERY_CONTEXT_HPP
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "perf_counters.hpp"
+#include "query.hpp"
+#include "query_budget.hpp"
+#include "query_cursors.hpp"
+
+// add a document to the min-heap of the k best documents found so far and
+// return the score of the k-th best one (0 while there are fewer than k)
+inline double
+push_top_k(std::vector<doc_score>& heap,size_t k,uint64_t doc_id,double score)
+{
+  if (heap.size() < k) {
+    heap.emplace_back(doc_id,score);
+    std::push_heap(heap.begin(),heap.end(),std::greater<doc_score>());
+  } else if (k > 0 && heap.front().score < score) {
+    std::pop_heap(heap.begin(),heap.end(),std::greater<doc_score>());
+    heap.back() = doc_score(doc_id,score);
+    std::push_heap(heap.begin(),heap.end(),std::greater<doc_score>());
+  }
+  return heap.size() < k || heap.empty() ? 0.0 : heap.front().score;
+}
+
+// move the heap into list in decreasing order of score, keeping the
+// capacity of both
+inline void
+top_k_to_list(std::vector<doc_score>& heap,std::vector<doc_score>& list)
+{
+  std::sort_heap(heap.begin(),heap.end(),std::greater<doc_score>());
+  list.assign(heap.begin(),heap.end());
+  heap.clear();
+}
+
+// Buffers of a running document at a time query. A search thread keeps
+// its context across queries, so once the buffers have grown to the
+// longest query and k seen, a query does not allocate memory. The result
+// of the last query is res; move it out to keep it beyond the next query.
+template<class t_pl>
+struct query_context {
+  query_cursors<t_pl> cursors;
+  std::vector<doc_score> heap;
+  std::vector<uint32_t> essential; // MaxScore: cursors in a heap by doc id
+  result res;
+  query_phase_counters* phase_counters = nullptr; // set to count phases
+  bool prefetch_next_block = true; // of the postings list iterators
+
+  query_context() = default;
+  query_context(const query_context&) = delete;
+  query_context& operator=(const query_context&) = delete;
+
+  void enter_phase(query_phase p) {
+    if (phase_counters) phase_counters->enter(p);
+  }
+};
+
+// where a WAND traversal stopped, so it can be resumed
+struct wand_state {
+  double threshold = 0;
+  double threshold_factor = 1; // candidates must beat factor * threshold
+  size_t initial_lists = 0;
+  double weight_bound = 0;
+  size_t pivot = 0;
+  double potential_score = 0;
+  uint64_t next_doc_id = 0;  // of the next candidate, max if done
+  query_deadline deadline;
+
+  explicit wand_state(const query_budget& budget)
+    : threshold_factor(budget.threshold_factor), deadline(budget) {}
+  bool done() const { return next_doc_id == std::numeric_limits<uint64_t>::max(); }
+};
+
+// Buffers of a batch of queries evaluated together. Like a query_context
+// it is kept across batches by a search thread.
+template<class t_pl>
+struct batch_context {
+  std::vector<std::unique_ptr<query_context<t_pl>>> queries;
+  std::vector<wand_state> states;
+  typename t_pl::shared_cache_type shared;
+  std::vector<std::pair<uint64_t,uint32_t>> terms; // (term id,handle)
+  std::vector<size_t> maxscore_queries; // run on their own, ascending
+  bool prefetch_next_block = true; // of the iterators of all queries
+
+  batch_context() = default;
+  batch_context(const batch_context&) = delete;
+  batch_context& operator=(const batch_context&) = delete;
+
+  // the result of query i of the last batch
+  result& res(size_t i) { return queries[i]->res; }
+};
+
+#endif
@@ -0,0 +1,270 @@
+#ifndef QUERY_CURSORS_HPP
+#define QUERY_CURSORS_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <memory>
+#include <new>
+#include <vector>
+
+// Cursor state of a query for the document at a time traversal.
+//
+// The state used to select pivots is kept in struct-of-arrays form, in
+// the doc id order of the cursors: the current doc id, the score bound of
+// the list and the query term of every cursor. The remaining state of a
+// term is only looked up when its cursor is moved or scored. These arrays
+// and the block decode buffers of all cursors are carved out of one cache
+// line aligned arena, so selecting a pivot reads a few contiguous lines
+// instead of following a pointer per list.
+//
+// For MaxScore the cursors are instead ordered by their bounds once per
+// query; the sums of the bounds in that order are then kept as well.
+//
+// The terms of a document are scored in the order of decreasing bound,
+// ties broken by the position of the term in the query: cursors on the
+// same document are kept in that order, and MaxScore reaches the lists
+// in it. The scores of a document are then added in the same order by
+// every traversal, so it scores the same to the last bit whichever finds
+// it.
+template<class t_pl>
+class query_cursors {
+public:
+  using plist_type = t_pl;
+  using iterator_type = typename plist_type::const_iterator;
+  using shared_cache_type = typename plist_type::shared_cache_type;
+  static const uint64_t finished = std::numeric_limits<uint64_t>::max();
+  static const uint64_t block_size = plist_type::block_size;
+  static const size_t cache_line = 64;
+  struct term_state {
+    iterator_type cur;
+    iterator_type end;
+    double f_qt;
+    double f_t;
+    double F_t;
+    double w_qt;            // query term weight of the ranker
+    double list_max_score;  // for f_qt of the query
+    double max_doc_weight;
+  };
+private:
+  struct free_deleter {
+    void operator()(uint8_t* p) const { free(p); }
+  };
+  std::unique_ptr<uint8_t,free_deleter> m_arena;
+  size_t m_capacity = 0;          // terms the arena has room for
+  bool m_prefetch = true;         // of the iterators, see reset()
+  size_t m_size = 0;              // cursors which are not finished
+  uint64_t* m_doc_ids = nullptr;  // in cursor order
+  double* m_max_scores = nullptr;
+  double* m_bound_sums = nullptr; // after sort_by_max_score()
+  uint32_t* m_terms = nullptr;
+  uint32_t* m_buffers = nullptr;  // 2*block_size words per term
+  std::vector<term_state> m_states; // in query order
+private:
+  static size_t round_up(size_t bytes) {
+    return (bytes + cache_line - 1) / cache_line * cache_line;
+  }
+  void allocate(size_t n) {
+    size_t ids_bytes = round_up(n*sizeof(uint64_t));
+    size_t scores_bytes = round_up(n*sizeof(double));
+    size_t terms_bytes = round_up(n*sizeof(uint32_t));
+    size_t buffer_bytes = n*2*block_size*sizeof(uint32_t);
+    void* mem = nullptr;
+    size_t total = ids_bytes+2*scores_bytes+terms_bytes+buffer_bytes;
+    if (posix_memalign(&mem,cache_line,std::max<size_t>(total,1)) != 0) {
+      throw std::bad_alloc();
+    }
+    m_arena.reset((uint8_t*)mem);
+    uint8_t* p = m_arena.get();
+    m_doc_ids = (uint64_t*)p; p += ids_bytes;
+    m_max_scores = (double*)p; p += scores_bytes;
+    m_bound_sums = (double*)p; p += scores_bytes;
+    m_terms = (uint32_t*)p; p += terms_bytes;
+    m_buffers = (uint32_t*)p;
+    m_capacity = n;
+  }
+  void move_cursor(size_t from,size_t to) {
+    m_doc_ids[to] = m_doc_ids[from];
+    m_max_scores[to] = m_max_scores[from];
+    m_terms[to] = m_terms[from];
+  }
+  // is cursor j scored before one of the given bound and term?
+  bool scored_before(size_t j,double score,uint32_t term) const {
+    return m_max_scores[j] > score ||
+           (m_max_scores[j] == score && m_terms[j] < term);
+  }
+  void update(size_t i) {
+    const auto& st = m_states[m_terms[i]];
+    m_doc_ids[i] = (st.cur == st.end) ? finished : st.cur.docid();
+  }
+public:
+  query_cursors() = default;
+  query_cursors(const query_cursors&) = delete;
+  query_cursors& operator=(const query_cursors&) = delete;
+
+  // start a query with up to n terms, whose iterators prefetch the block
+  // after the one they decode if prefetch_next_block is set
+  void reset(size_t n,bool prefetch_next_block = true) {
+    if (n > m_capacity) allocate(n);
+    m_prefetch = prefetch_next_block;
+    m_states.clear();
+    m_states.reserve(n);
+    m_size = 0;
+  }
+
+  // add a term; its blocks are decoded into the arena, or taken from the
+  // shared cache if the list is shared with other queries of a batch.
+  // f_t is the document frequency of the term, which is the size of pl
+  // unless the index is pruned.
+  template<class t_rank>
+  void add(const plist_type& pl,double F_t,double f_t,double f_qt,
+           const t_rank& ranker,shared_cache_type* shared = nullptr,
+           uint32_t shared_list = 0) {
+    uint32_t t = m_states.size();
+    m_states.emplace_back();
+    auto& st = m_states.back();
+    st.cur = pl.begin();
+    st.end = pl.end();
+    st.cur.prefetch_next_block(m_prefetch);
+    if (shared != nullptr) {
+      st.cur.use_shared_blocks(shared,shared_list);
+    } else {
+      st.cur.use_buffers(m_buffers + 2*t*block_size,
+                         m_buffers + (2*t+1)*block_size);
+    }
+    st.max_doc_weight = pl.max_doc_weight();
+    st.f_t = f_t;
+    st.F_t = F_t;
+    st.f_qt = f_qt;
+    st.w_qt = ranker.query_term_weight(st.f_qt,st.f_t);
+    st.list_max_score = ranker.max_posting_score(pl.list_max_score(),
+                                                 st.w_qt,st.f_t);
+    m_max_scores[m_size] = st.list_max_score;
+    m_terms[m_size] = t;
+    update(m_size);
+    m_size++;
+  }
+
+  // drop the cursors whose bound is at most min_score, unless that would
+  // drop all of them
+  void remove_low_bounds(double min_score) {
+    size_t kept = 0;
+    for (size_t i=0;i<m_size;i++) {
+      if (m_max_scores[i] > min_score) move_cursor(i,kept++);
+    }
+    if (kept > 0) {
+      m_size = kept;
+    } else { // we can not ignore all of them
+      m_size = m_states.size();
+      for (size_t i=0;i<m_size;i++) {
+        m_max_scores[i] = m_states[i].list_max_score;
+        m_terms[i] = i;
+        update(i);
+      }
+    }
+  }
+
+  // keep only the cursors of the terms that other, a cursor set of the
+  // same query, kept
+  void retain_terms(const query_cursors& other) {
+    size_t kept = 0;
+    for (size_t i=0;i<m_size;i++) {
+      for (size_t j=0;j<other.m_size;j++) {
+        if (other.m_terms[j] == m_terms[i]) {
+          move_cursor(i,kept++);
+          break;
+        }
+      }
+    }
+    m_size = kept;
+  }
+
+  size_t size() const { return m_size; }
+  bool empty() const { return m_size == 0; }
+  size_t num_terms() const { return m_states.size(); }
+
+  uint64_t doc_id(size_t i) const { return m_doc_ids[i]; }
+  double max_score(size_t i) const { return m_max_scores[i]; }
+  term_state& state(size_t i) { return m_states[m_terms[i]]; }
+  // position in the query of the term of cursor i
+  size_t term_index(size_t i) const { return m_terms[i]; }
+  const term_state& term(size_t t) const { return m_states[t]; }
+  const uint64_t* doc_ids() const { return m_doc_ids; }
+  const double* max_scores() const { return m_max_scores; }
+  // bound_sums()[i] is the sum of max_score(0) ... max_score(i), valid
+  // from sort_by_max_score() until a cursor is reordered
+  const double* bound_sums() const { return m_bound_sums; }
+
+  void next(size_t i) {
+    ++(state(i).cur);
+    update(i);
+  }
+
+  void skip_to(size_t i,uint64_t id) {
+    state(i).cur.skip_to_id(id);
+    update(i);
+  }
+
+  // drop finished cursors, which are at the end of the id order
+  void remove_finished() {
+    while (m_size > 0 && m_doc_ids[m_size-1] == finished) m_size--;
+  }
+
+  // move cursor i, which was advanced, back to its place in the id order
+  void reposition(size_t i) {
+    uint64_t id = m_doc_ids[i];
+    double score = m_max_scores[i];
+    uint32_t term = m_terms[i];
+    while (i+1 < m_size && (m_doc_ids[i+1] < id ||
+           (m_doc_ids[i+1] == id && scored_before(i+1,score,term)))) {
+      move_cursor(i+1,i);
+      i++;
+    }
+    m_doc_ids[i] = id;
+    m_max_scores[i] = score;
+    m_terms[i] = term;
+  }
+
+  // restore the id order after the first n cursors were advanced, which
+  // only moves these cursors instead of sorting all of them
+  void reorder_advanced(size_t n) {
+    for (size_t i=n;i-- > 0;) {
+      reposition(i);
+    }
+    remove_finished();
+  }
+
+  void sort_by_id() {
+    reorder_advanced(m_size);
+  }
+
+  // order the cursors by increasing bound, so that the last is scored
+  // first, drop the finished ones and sum up the bounds
+  void sort_by_max_score() {
+    size_t kept = 0;
+    for (size_t i=0;i<m_size;i++) {
+      if (m_doc_ids[i] != finished) move_cursor(i,kept++);
+    }
+    m_size = kept;
+    for (size_t i=1;i<m_size;i++) {
+      uint64_t id = m_doc_ids[i];
+      double score = m_max_scores[i];
+      uint32_t term = m_terms[i];
+      size_t j = i;
+      for (;j > 0 && scored_before(j-1,score,term);j--) {
+        move_cursor(j-1,j);
+      }
+      m_doc_ids[j] = id;
+      m_max_scores[j] = score;
+      m_terms[j] = term;
+    }
+    double sum = 0;
+    for (size_t i=0;i<m_size;i++) {
+      sum += m_max_scores[i];
+      m_bound_sums[i] = sum;
+    }
+  }
+};
+
+#endif
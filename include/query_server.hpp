@@ -0,0 +1,313 @@
+#ifndef QUERY_SERVER_HPP
+#define QUERY_SERVER_HPP
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "concurrent_queue.hpp"
+#include "query.hpp"
+#include "docno_table.hpp"
+
+// One connected client. Requests are read by a dedicated thread; responses
+// are written by the workers, one complete response at a time.
+struct client_connection {
+  int in_fd;
+  int out_fd;
+  std::mutex write_mutex;
+  std::atomic<bool> broken;
+  std::atomic<bool> finished; // the client closed its end
+  client_connection(int in,int out)
+    : in_fd(in), out_fd(out), broken(false), finished(false) {}
+  ~client_connection() {
+    if (in_fd > 2) close(in_fd);
+    if (out_fd > 2 && out_fd != in_fd) close(out_fd);
+  }
+  void write_response(const std::string& response) {
+    std::lock_guard<std::mutex> lock(write_mutex);
+    const char* data = response.data();
+    size_t left = response.size();
+    while (left > 0 && !broken) {
+      ssize_t written = write(out_fd,data,left);
+      if (written < 0) {
+        if (errno == EINTR) continue;
+        broken = true; // client went away
+        break;
+      }
+      data += written;
+      left -= written;
+    }
+  }
+};
+
+// Write end of the pipe through which SIGINT and SIGTERM stop a socket
+// server; writing to a pipe is async-signal-safe, unlike anything the
+// server would do to shut down.
+static volatile sig_atomic_t query_server_signal_fd = -1;
+
+inline void query_server_signal_handler(int)
+{
+  int saved_errno = errno;
+  char c = 0;
+  if (write(query_server_signal_fd,&c,1) < 0) {
+    // the pipe is full, a shutdown is already pending
+  }
+  errno = saved_errno;
+}
+
+// Long running query server. The index, dictionary and document names are
+// loaded once by the caller, which also supplies the function that runs a
+// query against the index. Clients send one "qid;terms" query per line and
+// receive the TREC run lines of the query followed by an empty line.
+// Responses to queries of the same client may be returned out of order when
+// more than one worker is used; they are matched by query id. At most
+// max_pending requests wait for a worker; beyond that the readers of the
+// clients block, so a client sending faster than the server answers is
+// slowed down instead of filling memory.
+class query_server {
+public:
+  using doc_names_t = docno_table;
+  // runs a query in buffers of the calling thread
+  using search_fn_t =
+    std::function<const result&(const std::vector<query_token>&)>;
+  // called by each worker thread with its number before it serves queries
+  using worker_init_fn_t = std::function<void(size_t)>;
+  static const size_t max_pending = 4096;
+private:
+  struct request {
+    std::shared_ptr<client_connection> client;
+    std::string query_str;
+  };
+  search_fn_t m_search;
+  const query_parser::mapping_t& m_mapping;
+  const doc_names_t& m_doc_names;
+  concurrent_queue<request> m_requests;
+  std::vector<std::thread> m_workers;
+  // the reader threads of the socket clients; they use the server, so
+  // stop() joins them before it returns. The connection is only watched:
+  // it is closed, and the client sees the end of the answers, once the
+  // reader and the requests it queued are done with it.
+  struct client_reader {
+    std::thread thread;
+    std::weak_ptr<client_connection> client;
+  };
+  std::mutex m_clients_mutex;
+  std::vector<client_reader> m_clients;
+public:
+  query_server(search_fn_t search,const query_parser::mapping_t& mapping,
+               const doc_names_t& doc_names)
+    : m_search(search), m_mapping(mapping), m_doc_names(doc_names),
+      m_requests(max_pending)
+  {
+  }
+
+  ~query_server() {
+    stop();
+  }
+
+  void start(size_t num_threads,worker_init_fn_t init = nullptr) {
+    signal(SIGPIPE,SIG_IGN); // a vanishing client must not kill the server
+    for (size_t i=0;i<std::max<size_t>(1,num_threads);i++) {
+      m_workers.emplace_back(&query_server::worker,this,i,init);
+    }
+  }
+
+  // stop accepting requests and wait for the pending ones. Clients that
+  // are still connected are not read any further, but get the answers to
+  // the queries they have sent.
+  void stop() {
+    join_clients(true);
+    m_requests.close();
+    for (auto& w : m_workers) w.join();
+    m_workers.clear();
+  }
+
+  // read queries until the client closes its end
+  void serve_client(std::shared_ptr<client_connection> client) {
+    std::string buffer;
+    char chunk[4096];
+    while (true) {
+      ssize_t n = read(client->in_fd,chunk,sizeof(chunk));
+      if (n < 0 && errno == EINTR) continue;
+      if (n <= 0) break;
+      buffer.append(chunk,n);
+      size_t line_start = 0;
+      size_t line_end;
+      while ((line_end = buffer.find('\n',line_start)) != std::string::npos) {
+        enqueue(client,buffer.substr(line_start,line_end-line_start));
+        line_start = line_end + 1;
+      }
+      buffer.erase(0,line_start);
+    }
+    enqueue(client,buffer);
+    client->finished = true;
+  }
+
+  // serve queries from stdin, answers go to stdout
+  void serve_stdin() {
+    serve_client(std::make_shared<client_connection>(STDIN_FILENO,
+                                                      STDOUT_FILENO));
+  }
+
+  // accept clients on a unix domain socket until accept fails or the
+  // process gets SIGINT or SIGTERM. The socket file is removed on return;
+  // stop() then answers the requests already read.
+  void serve_socket(const std::string& socket_path) {
+    int listen_fd = socket(AF_UNIX,SOCK_STREAM,0);
+    if (listen_fd < 0) {
+      perror("could not create socket");
+      exit(EXIT_FAILURE);
+    }
+    struct sockaddr_un addr;
+    memset(&addr,0,sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(addr.sun_path)) {
+      std::cerr << "socket path too long: " << socket_path << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    strncpy(addr.sun_path,socket_path.c_str(),sizeof(addr.sun_path)-1);
+    unlink(socket_path.c_str());
+    if (bind(listen_fd,(struct sockaddr*)&addr,sizeof(addr)) < 0 ||
+        listen(listen_fd,SOMAXCONN) < 0) {
+      perror("could not listen on socket");
+      exit(EXIT_FAILURE);
+    }
+    // a client may go away between poll and accept
+    fcntl(listen_fd,F_SETFL,fcntl(listen_fd,F_GETFL) | O_NONBLOCK);
+
+    int signal_pipe[2];
+    if (pipe(signal_pipe) < 0) {
+      perror("could not create signal pipe");
+      exit(EXIT_FAILURE);
+    }
+    for (int fd : signal_pipe) {
+      fcntl(fd,F_SETFL,fcntl(fd,F_GETFL) | O_NONBLOCK);
+      fcntl(fd,F_SETFD,FD_CLOEXEC);
+    }
+    query_server_signal_fd = signal_pipe[1];
+    struct sigaction sa, old_int, old_term;
+    memset(&sa,0,sizeof(sa));
+    sa.sa_handler = query_server_signal_handler;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT,&sa,&old_int);
+    sigaction(SIGTERM,&sa,&old_term);
+
+    std::cout << "Listening on " << socket_path << std::endl;
+    while (true) {
+      struct pollfd fds[2] = {{listen_fd,POLLIN,0},{signal_pipe[0],POLLIN,0}};
+      if (poll(fds,2,-1) < 0) {
+        if (errno == EINTR) continue;
+        perror("poll failed");
+        break;
+      }
+      if (fds[1].revents != 0) {
+        std::cerr << "Shutting down." << std::endl;
+        break;
+      }
+      int fd = accept(listen_fd,NULL,NULL);
+      if (fd < 0) {
+        if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK ||
+            errno == ECONNABORTED) continue;
+        perror("accept failed");
+        break;
+      }
+      // the clients read blocking, whatever accept inherits
+      fcntl(fd,F_SETFL,fcntl(fd,F_GETFL) & ~O_NONBLOCK);
+      auto client = std::make_shared<client_connection>(fd,fd);
+      join_clients(false);
+      std::lock_guard<std::mutex> lock(m_clients_mutex);
+      m_clients.push_back({std::thread(&query_server::serve_client,this,
+                                       client),client});
+    }
+    close(listen_fd);
+    unlink(socket_path.c_str());
+    sigaction(SIGINT,&old_int,NULL);
+    sigaction(SIGTERM,&old_term,NULL);
+    query_server_signal_fd = -1;
+    close(signal_pipe[0]);
+    close(signal_pipe[1]);
+  }
+private:
+  // join the reader threads of the clients that have gone, or of all
+  // clients after shutting down the reading side of their sockets. A
+  // connection is only shut down while it is held open, so its fd cannot
+  // have been reused; one that is closed has no reader left.
+  void join_clients(bool all) {
+    std::lock_guard<std::mutex> lock(m_clients_mutex);
+    size_t kept = 0;
+    for (size_t i=0;i<m_clients.size();i++) {
+      auto& c = m_clients[i];
+      auto client = c.client.lock();
+      if (all && client) shutdown(client->in_fd,SHUT_RD);
+      if (all || !client || client->finished) {
+        c.thread.join();
+      } else {
+        if (kept != i) m_clients[kept] = std::move(c);
+        kept++;
+      }
+    }
+    m_clients.resize(kept);
+  }
+
+  void enqueue(const std::shared_ptr<client_connection>& client,
+               std::string line) {
+    if (!line.empty() && line.back() == '\r') line.pop_back();
+    if (line.empty()) return;
+    m_requests.push({client,std::move(line)});
+  }
+
+  void worker(size_t id,worker_init_fn_t init) {
+    if (init) init(id);
+    request req;
+    while (m_requests.pop(req)) {
+      req.client->write_response(process(req.query_str));
+      req.client.reset();
+    }
+  }
+
+  std::string process(const std::string& query_str) {
+    std::ostringstream out;
+    std::pair<bool,query_t> parsed;
+    try {
+      parsed = query_parser::parse_query(m_mapping,query_str);
+    } catch (const std::exception& e) {
+      out << "ERR malformed query '" << query_str << "'\n\n";
+      return out.str();
+    }
+    if (!parsed.first) {
+      out << "ERR could not parse query '" << query_str << "'\n\n";
+      return out.str();
+    }
+    auto qry_id = std::get<0>(parsed.second);
+    const auto& qry_tokens = std::get<1>(parsed.second);
+    if (!qry_tokens.empty()) {
+      const auto& res = m_search(qry_tokens);
+      for (size_t i=1;i<=res.list.size();i++) {
+        out << qry_id << "\t"
+            << "Q0" << "\t"
+            << m_doc_names[res.list[i-1].doc_id] << "\t"
+            << i << "\t"
+            << res.list[i-1].score << "\t"
+            << "WANDbl" << "\n";
+      }
+    }
+    out << "\n";
+    return out.str();
+  }
+};
+
+#endif
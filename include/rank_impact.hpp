@@ -0,0 +1,54 @@
+#ifndef RANK_IMPACT_HPP
+#define RANK_IMPACT_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Ranker of the indexes of mk_impact_idx. The f_dt of a posting is not a
+// term frequency but a precomputed integer impact of the term in the
+// document, for example a quantized learned sparse weight, and f_qt is the
+// weight of the query term. A document scores
+//   sum over the query terms t of f_qt * f_dt,
+// so the list maximum stored for f_qt = 1 is the highest impact of the
+// list and scales with the weight of the query term.
+struct my_rank_impact {
+  size_t num_docs = 0;
+  static std::string name() {
+    return "impact";
+  }
+  my_rank_impact(){}
+  my_rank_impact& operator=(const my_rank_impact&) = default;
+
+  my_rank_impact(std::vector<uint64_t> doc_len,uint64_t terms)
+    : my_rank_impact(doc_len,terms,doc_len.size()) { }
+
+  my_rank_impact(std::vector<uint64_t>,uint64_t,uint64_t numdocs)
+    : num_docs(numdocs) { }
+
+  double doc_length(size_t) const {
+    return 0;
+  }
+  double calc_doc_weight(double) const {
+    return 0;
+  }
+  double calculate_docscore(const double f_qt,const double f_dt,
+                            const double,const double,bool) const {
+    return f_qt * f_dt;
+  }
+
+  double query_term_weight(const double f_qt,const double) const {
+    return f_qt;
+  }
+  double posting_score(const double w_qt,const double f_dt,uint64_t) const {
+    return w_qt * f_dt;
+  }
+  // the slack covers the rounding of sums of fractional query weights,
+  // which the traversal adds up in a different order than the scores
+  double max_posting_score(const double list_max_score,const double w_qt,
+                           const double) const {
+    return list_max_score * w_qt * (1+1e-12);
+  }
+};
+
+#endif
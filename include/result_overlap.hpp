@@ -0,0 +1,64 @@
+#ifndef RESULT_OVERLAP_HPP
+#define RESULT_OVERLAP_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <unordered_set>
+#include <vector>
+
+#include "query.hpp"
+
+// Agreement of an approximate result with the exact one, both in rank
+// order. Used to measure what a threshold factor > 1 costs.
+
+// the fraction of the first k documents of exact that are among the first
+// k of approx; 1 if exact is empty
+inline double
+overlap_at_k(const std::vector<doc_score>& exact,
+             const std::vector<doc_score>& approx,size_t k)
+{
+  size_t n = std::min(k,exact.size());
+  if (n == 0) return 1.0;
+  std::unordered_set<uint64_t> approx_ids;
+  for (size_t i=0;i<std::min(k,approx.size());i++) {
+    approx_ids.insert(approx[i].doc_id);
+  }
+  size_t common = 0;
+  for (size_t i=0;i<n;i++) {
+    common += approx_ids.count(exact[i].doc_id);
+  }
+  return (double)common / (double)n;
+}
+
+// Rank-biased overlap (Webber, Moffat and Zobel, TOIS 2010) with
+// persistence p, extrapolated from the depth of the longer list: 1 for
+// identical rankings, 0 for disjoint ones, and a swap near the top costs
+// more than one near the bottom.
+inline double
+rank_biased_overlap(const std::vector<doc_score>& exact,
+                    const std::vector<doc_score>& approx,double p = 0.9)
+{
+  size_t depth = std::max(exact.size(),approx.size());
+  if (depth == 0) return 1.0;
+  std::unordered_set<uint64_t> seen_exact, seen_approx;
+  size_t common = 0;
+  double sum = 0, weight = 1;
+  for (size_t d=1;d<=depth;d++) {
+    if (d <= exact.size()) {
+      uint64_t id = exact[d-1].doc_id;
+      if (seen_approx.count(id)) common++;
+      seen_exact.insert(id);
+    }
+    if (d <= approx.size()) {
+      uint64_t id = approx[d-1].doc_id;
+      if (seen_exact.count(id)) common++;
+      seen_approx.insert(id);
+    }
+    weight *= p;
+    sum += (double)common / d * weight;
+  }
+  return (double)common / depth * weight + (1-p) / p * sum;
+}
+
+#endif
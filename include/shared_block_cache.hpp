@@ -0,0 +1,109 @@
+#ifndef SHARED_BLOCK_CACHE_HPP
+#define SHARED_BLOCK_CACHE_HPP
+
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+#include "block_postings_list.hpp"
+
+// Decoded blocks of the postings lists shared by the queries of a batch.
+// Every list has a few slots, each holding one decoded block and the number
+// of iterators reading it. An iterator pins the block it is positioned in
+// and releases it when it moves on, so a list shared by n queries never
+// needs more than n+1 slots: at most n are pinned and the last one takes
+// the next block.
+template<uint64_t t_bs>
+class shared_block_cache {
+public:
+  using list_type = block_postings_list<t_bs>;
+  using view_type = block_postings_view<t_bs>;
+  using size_type = typename list_type::size_type;
+  static const uint32_t no_slot = std::numeric_limits<uint32_t>::max();
+private:
+  struct slot {
+    uint64_t block_id;
+    uint32_t refs;
+    uint32_t size;
+  };
+  struct list_slots {
+    view_type pl;
+    uint32_t first;
+    uint32_t num;
+  };
+  std::vector<list_slots> m_lists;
+  std::vector<slot> m_slots;
+  std::vector<uint32_t, FastPForLib::cacheallocator> m_buffers;
+  uint64_t m_decodes = 0;
+  uint64_t m_requests = 0;
+  bool m_prefetch = true;
+private:
+  uint32_t* ids(uint32_t s) { return m_buffers.data() + 2*t_bs*s; }
+  uint32_t* freqs(uint32_t s) { return ids(s) + t_bs; }
+public:
+  // forget all lists and blocks, keeping the memory. The blocks after
+  // those decoded are prefetched if prefetch_next_block is set.
+  void clear(bool prefetch_next_block = true) {
+    m_prefetch = prefetch_next_block;
+    m_lists.clear();
+    m_slots.clear();
+    m_decodes = 0;
+    m_requests = 0;
+  }
+
+  // share pl between n iterators, returns the handle of the list
+  uint32_t add_list(const list_type& pl,uint32_t n) {
+    m_lists.push_back(list_slots{pl.view(),(uint32_t)m_slots.size(),n+1});
+    m_slots.resize(m_slots.size()+n+1,
+                   slot{std::numeric_limits<uint64_t>::max(),0,0});
+    if (m_buffers.size() < m_slots.size()*2*t_bs) {
+      // the iterators of the batch have not been given any buffers yet
+      m_buffers.resize(m_slots.size()*2*t_bs);
+    }
+    return m_lists.size()-1;
+  }
+
+  // pin block_id of the list, decoding it unless another iterator already
+  // did, and return its slot and buffers
+  uint32_t acquire(uint32_t list,size_type block_id,uint32_t*& id_data,
+                   uint32_t*& freq_data,size_type& size) {
+    const auto& ls = m_lists[list];
+    m_requests++;
+    uint32_t free_slot = no_slot;
+    for (uint32_t s=ls.first;s<ls.first+ls.num;s++) {
+      if (m_slots[s].block_id == block_id) {
+        m_slots[s].refs++;
+        id_data = ids(s); freq_data = freqs(s); size = m_slots[s].size;
+        return s;
+      }
+      // prefer the lowest unpinned block; the queries move forward
+      if (m_slots[s].refs == 0 && (free_slot == no_slot ||
+          m_slots[s].block_id < m_slots[free_slot].block_id)) {
+        free_slot = s;
+      }
+    }
+    if (free_slot == no_slot) {
+      throw std::logic_error("all slots of a shared list are pinned.");
+    }
+    auto& sl = m_slots[free_slot];
+    sl.block_id = block_id;
+    sl.refs = 1;
+    sl.size = ls.pl.decompress_block(block_id,ids(free_slot),freqs(free_slot));
+    if (m_prefetch) ls.pl.prefetch_block(block_id+1);
+    m_decodes++;
+    id_data = ids(free_slot); freq_data = freqs(free_slot);
+    size = sl.size;
+    return free_slot;
+  }
+
+  void release(uint32_t s) {
+    m_slots[s].refs--;
+  }
+
+  // blocks decoded and blocks asked for since clear()
+  uint64_t decodes() const { return m_decodes; }
+  uint64_t requests() const { return m_requests; }
+};
+
+#endif
@@ -0,0 +1,138 @@
+#ifndef STATIC_PRUNING_HPP
+#define STATIC_PRUNING_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "sdsl/io.hpp"
+
+// Parameters of the static pruning of mk_wand_idx. A posting is dropped if
+// its score for f_qt = 1 is below the cutoff of its list, which is the
+// larger of
+//  - epsilon times the top_k-th highest score of the list (the uniform
+//    top-k criterion of Carmel et al., SIGIR 2001), if top_k > 0, and
+//  - the global cutoff.
+struct pruning_params {
+  uint64_t top_k = 0;
+  double epsilon = 1.0;
+  double global_cutoff = 0.0;
+  bool enabled() const { return top_k > 0 || global_cutoff > 0; }
+};
+
+// what the pruning kept of all lists
+struct pruning_stats {
+  uint64_t postings = 0;
+  uint64_t postings_kept = 0;
+  uint64_t lists = 0;
+  uint64_t lists_pruned = 0;   // lost at least one posting
+  uint64_t lists_emptied = 0;
+  double score_mass = 0;       // sum of the scores of all postings
+  double score_mass_kept = 0;
+
+  void print(std::ostream& out) const {
+    out << "Pruning kept " << postings_kept << " of " << postings
+        << " postings (" << 100.0 * postings_kept / std::max<uint64_t>(1,postings)
+        << "%) and " << 100.0 * score_mass_kept / std::max(1e-300,score_mass)
+        << "% of the score mass. " << lists_pruned << " of " << lists
+        << " lists lost postings, " << lists_emptied << " all of them."
+        << std::endl;
+  }
+};
+
+// Drop the postings of one list whose score is below its cutoff, keeping
+// the order of the others. Scores are those of the list maxima: f_qt = 1
+// and the document frequency f_t of the full list. Returns the highest
+// score of a dropped posting, 0 if none was dropped; at query time it
+// bounds what the list lost for a document.
+template<class t_rank>
+double
+prune_postings(std::vector<std::pair<uint64_t,uint64_t>>& postings,
+               const t_rank& ranker,const pruning_params& params,
+               pruning_stats& stats)
+{
+  double f_t = postings.size();
+  std::vector<double> scores(postings.size());
+  for (size_t i=0;i<postings.size();i++) {
+    double W_d = ranker.doc_length(postings[i].first);
+    scores[i] = ranker.calculate_docscore(1.0,postings[i].second,f_t,W_d,
+                                          true);
+    stats.score_mass += scores[i];
+  }
+
+  double cutoff = params.global_cutoff;
+  if (params.top_k > 0 && params.top_k < scores.size()) {
+    std::vector<double> sorted(scores);
+    std::nth_element(sorted.begin(),sorted.begin()+params.top_k-1,
+                     sorted.end(),std::greater<double>());
+    cutoff = std::max(cutoff,params.epsilon * sorted[params.top_k-1]);
+  }
+
+  double max_dropped = 0;
+  size_t kept = 0;
+  for (size_t i=0;i<postings.size();i++) {
+    if (scores[i] >= cutoff) {
+      postings[kept++] = postings[i];
+      stats.score_mass_kept += scores[i];
+    } else {
+      max_dropped = std::max(max_dropped,scores[i]);
+    }
+  }
+  stats.lists++;
+  stats.postings += postings.size();
+  stats.postings_kept += kept;
+  if (kept < postings.size()) stats.lists_pruned++;
+  if (kept == 0 && !postings.empty()) stats.lists_emptied++;
+  postings.resize(kept);
+  return max_dropped;
+}
+
+// Prune one list and build the list the pruned index stores. A list that
+// loses all its postings is stored as an empty list, as postings lists
+// cannot be built from no postings. Returns the cutoff of prune_postings.
+template<class t_plist,class t_rank>
+double
+prune_list(std::vector<std::pair<uint64_t,uint64_t>>& postings,
+           const t_rank& ranker,const pruning_params& params,
+           pruning_stats& stats,t_plist& pruned)
+{
+  uint64_t f_t = postings.size();
+  pruned = t_plist();
+  if (postings.empty()) return 0;
+  double cutoff = prune_postings(postings,ranker,params,stats);
+  if (!postings.empty()) pruned = t_plist(ranker,postings,f_t);
+  return cutoff;
+}
+
+// The highest dropped score of every list of a pruned index, in the order
+// of the lists.
+inline void
+write_pruning_cutoffs(const std::vector<double>& cutoffs,
+                      const std::string& file_name)
+{
+  std::ofstream out(file_name);
+  uint64_t n = cutoffs.size();
+  sdsl::write_member(n,out);
+  out.write((const char*)cutoffs.data(),n*sizeof(double));
+}
+
+inline std::vector<double>
+read_pruning_cutoffs(const std::string& file_name)
+{
+  std::ifstream in(file_name);
+  if (!in.is_open()) {
+    std::cerr << "Could not open file: " << file_name << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  uint64_t n = 0;
+  sdsl::read_member(n,in);
+  std::vector<double> cutoffs(n);
+  in.read((char*)cutoffs.data(),n*sizeof(double));
+  return cutoffs;
+}
+
+#endif
@@ -0,0 +1,136 @@
+#ifndef SYNTHETIC_INDEX_HPP
+#define SYNTHETIC_INDEX_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "query.hpp"
+
+// In-process synthetic collections with Zipfian document frequencies. Used
+// by the benchmark and verification tools so they run without a GOV2/CW09
+// index on disk.
+struct synthetic_collection {
+  uint64_t num_docs = 0;
+  uint64_t num_terms = 0; // total number of term occurrences
+  std::vector<uint64_t> doc_lengths;
+  // postings[t] holds the (doc_id,f_dt) pairs of term t sorted by doc_id
+  std::vector<std::vector<std::pair<uint64_t,uint64_t>>> postings;
+};
+
+// draw n distinct sorted doc ids from [0,num_docs)
+inline std::vector<uint64_t>
+sample_doc_ids(std::mt19937_64& gen,uint64_t num_docs,uint64_t n)
+{
+  std::vector<uint64_t> ids;
+  if (n * 16 >= num_docs) { // dense: bernoulli scan
+    std::bernoulli_distribution coin((double)n/(double)num_docs);
+    for (uint64_t d=0;d<num_docs;d++) {
+      if (coin(gen)) ids.push_back(d);
+    }
+    if (ids.empty()) ids.push_back(num_docs-1);
+    return ids;
+  }
+  std::uniform_int_distribution<uint64_t> dist(0,num_docs-1);
+  ids.reserve(n);
+  while (ids.size() < n) {
+    while (ids.size() < n) ids.push_back(dist(gen));
+    std::sort(ids.begin(),ids.end());
+    ids.erase(std::unique(ids.begin(),ids.end()),ids.end());
+  }
+  return ids;
+}
+
+// Term t (0-based rank) occurs in about max_df_ratio*num_docs/(t+1)^zipf_s
+// documents. Within-document frequencies are 1+geometric.
+inline synthetic_collection
+make_zipf_collection(uint64_t num_docs,uint64_t vocab_size,
+                     double zipf_s = 1.0,double max_df_ratio = 0.3,
+                     uint64_t seed = 4711)
+{
+  synthetic_collection col;
+  col.num_docs = num_docs;
+  col.doc_lengths.assign(num_docs,0);
+  col.postings.resize(vocab_size);
+
+  std::mt19937_64 gen(seed);
+  std::geometric_distribution<uint64_t> fdist(0.55);
+  for (uint64_t t=0;t<vocab_size;t++) {
+    double df = max_df_ratio * num_docs / std::pow((double)(t+1),zipf_s);
+    uint64_t n = std::max<uint64_t>(1,std::min<uint64_t>(num_docs,df));
+    auto ids = sample_doc_ids(gen,num_docs,n);
+    auto& pl = col.postings[t];
+    pl.reserve(ids.size());
+    for (const auto& id : ids) {
+      uint64_t f_dt = 1 + fdist(gen);
+      pl.emplace_back(id,f_dt);
+      col.doc_lengths[id] += f_dt;
+      col.num_terms += f_dt;
+    }
+  }
+  // every document has at least one (unindexed) term
+  for (auto& len : col.doc_lengths) {
+    if (len == 0) {
+      len = 1;
+      col.num_terms++;
+    }
+  }
+  return col;
+}
+
+// random queries over the most frequent max_rank terms
+inline std::vector<query_t>
+make_synthetic_queries(const synthetic_collection& col,size_t num_queries,
+                       size_t terms_per_query,size_t max_rank,
+                       uint64_t seed = 42)
+{
+  std::mt19937_64 gen(seed);
+  max_rank = std::min<size_t>(max_rank,col.postings.size());
+  terms_per_query = std::min(terms_per_query,max_rank);
+  std::uniform_int_distribution<uint64_t> dist(0,max_rank-1);
+  std::vector<query_t> queries;
+  for (size_t q=0;q<num_queries;q++) {
+    std::vector<uint64_t> ids;
+    while (ids.size() < terms_per_query) {
+      auto id = dist(gen);
+      if (std::find(ids.begin(),ids.end(),id) == ids.end()) ids.push_back(id);
+    }
+    std::sort(ids.begin(),ids.end());
+    std::vector<query_token> tokens;
+    for (const auto& id : ids) {
+      tokens.emplace_back(std::vector<uint64_t>(1,id),
+                          std::vector<std::string>(),1);
+    }
+    queries.emplace_back(q,tokens);
+  }
+  return queries;
+}
+
+// build an in-memory index over a synthetic collection; dense lists are
+// stored as bitmaps unless dense_lists is false
+template<class t_index>
+void construct_synthetic(t_index& idx,synthetic_collection col,
+                         bool dense_lists = true)
+{
+  using plist_type = typename t_index::plist_type;
+  using ranker_type = typename t_index::ranker_type;
+
+  ranker_type ranker(col.doc_lengths,col.num_terms,col.num_docs);
+  std::vector<plist_type> lists(col.postings.size());
+  sdsl::int_vector<> F_t(col.postings.size());
+  sdsl::int_vector<> f_t(col.postings.size());
+  for (size_t t=0;t<col.postings.size();t++) {
+    uint64_t sum = 0;
+    for (const auto& p : col.postings[t]) sum += p.second;
+    F_t[t] = sum;
+    f_t[t] = col.postings[t].size();
+    lists[t] = plist_type(ranker,col.postings[t],dense_lists);
+  }
+  idx = t_index(std::move(lists),std::move(F_t),std::move(f_t));
+  idx.load(col.doc_lengths,col.num_terms,col.num_docs);
+}
+
+#endif
@@ -0,0 +1,127 @@
+#ifndef TERM_DICTIONARY_HPP
+#define TERM_DICTIONARY_HPP
+
+#include <algorithm>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "front_coded_vector.hpp"
+#include "mmap_file.hpp"
+
+// Term dictionary written by mk_wand_idx as dict.bin. The terms are stored
+// sorted and front coded, followed by the term id of every term:
+//   uint64_t magic, front_coded_vector terms, uint64_t ids[terms.size()]
+// The file is memory mapped, so loading does not depend on the vocabulary
+// size. The id -> term direction is only needed to print queries given as
+// term ids; its (4 bytes per term) table is built on first use.
+class term_dictionary {
+public:
+  static const uint64_t magic = 0x3143494457444e57ULL; // "WNDWDIC1"
+  static const uint64_t bucket_size = 16;
+private:
+  struct reverse_mapping {
+    std::once_flag built;
+    std::vector<uint32_t> rank_of_id;
+  };
+  mmap_file m_file;
+  std::vector<uint64_t> m_buffer; // used if not memory mapped
+  front_coded_vector m_terms;
+  const uint64_t* m_ids = nullptr;
+  std::unique_ptr<reverse_mapping> m_reverse;
+private:
+  void map(const uint8_t* data,size_t size,const std::string& name) {
+    const uint64_t* header = (const uint64_t*) data;
+    if (size < 2*sizeof(uint64_t) || header[0] != magic) {
+      std::cerr << "ERROR: " << name << " is not a term dictionary."
+                << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    size_t bytes = m_terms.map(data + sizeof(uint64_t));
+    m_ids = (const uint64_t*)(data + sizeof(uint64_t) + bytes);
+    m_reverse.reset(new reverse_mapping());
+  }
+public:
+  term_dictionary() = default;
+  term_dictionary(term_dictionary&&) = default;
+  term_dictionary& operator=(term_dictionary&&) = default;
+
+  // memory map a dictionary written by serialize()
+  explicit term_dictionary(const std::string& file_name)
+    : m_file(file_name) {
+    map(m_file.data(),m_file.size(),file_name);
+  }
+
+  // build the dictionary in memory from a dict.txt file
+  static term_dictionary from_text(const std::string& file_name) {
+    std::ifstream dfs(file_name);
+    if(!dfs.is_open()) {
+      std::cerr << "cannot load dictionary file.";
+      exit(EXIT_FAILURE);
+    }
+    std::vector<std::pair<std::string,uint64_t>> entries;
+    std::string term_mapping;
+    while( std::getline(dfs,term_mapping) ) {
+      auto sep_pos = term_mapping.find(' ');
+      auto term = term_mapping.substr(0,sep_pos);
+      auto idstr = term_mapping.substr(sep_pos+1);
+      entries.emplace_back(term,std::stoull(idstr));
+    }
+    std::ostringstream out;
+    serialize(entries,out);
+    auto bytes = out.str();
+
+    term_dictionary dict;
+    dict.m_buffer.resize((bytes.size()+7)/8);
+    memcpy(dict.m_buffer.data(),bytes.data(),bytes.size());
+    dict.map((const uint8_t*)dict.m_buffer.data(),bytes.size(),file_name);
+    return dict;
+  }
+
+  static void serialize(std::vector<std::pair<std::string,uint64_t>> entries,
+                        std::ostream& out) {
+    std::sort(entries.begin(),entries.end());
+    std::vector<std::string> terms;
+    std::vector<uint64_t> ids;
+    terms.reserve(entries.size());
+    ids.reserve(entries.size());
+    for (auto& e : entries) {
+      terms.emplace_back(std::move(e.first));
+      ids.push_back(e.second);
+    }
+    uint64_t header = magic;
+    out.write((const char*)&header,sizeof(header));
+    front_coded_vector::serialize(terms,bucket_size,out);
+    out.write((const char*)ids.data(),ids.size()*sizeof(uint64_t));
+  }
+
+  uint64_t size() const { return m_terms.size(); }
+
+  // id of term; false if the term is not in the dictionary
+  std::pair<bool,uint64_t> find(const std::string& term) const {
+    auto rank = m_terms.lookup(term);
+    if (rank == front_coded_vector::not_found) return {false,0};
+    return {true,m_ids[rank]};
+  }
+
+  // term with the given id; false if there is no such id
+  std::pair<bool,std::string> term(uint64_t id) const {
+    auto& rev = *m_reverse;
+    std::call_once(rev.built,[this,&rev]() {
+      uint64_t max_id = 0;
+      for (size_t i=0;i<size();i++) max_id = std::max(max_id,m_ids[i]);
+      rev.rank_of_id.assign(size() ? max_id+1 : 0,(uint32_t)-1);
+      for (size_t i=0;i<size();i++) rev.rank_of_id[m_ids[i]] = i;
+    });
+    if (id >= rev.rank_of_id.size() || rev.rank_of_id[id] == (uint32_t)-1) {
+      return {false,""};
+    }
+    return {true,m_terms[rev.rank_of_id[id]]};
+  }
+};
+
+#endif
@@ -0,0 +1,162 @@
+#ifndef TIERED_INDEX_HPP
+#define TIERED_INDEX_HPP
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+#include "query.hpp"
+#include "query_budget.hpp"
+
+// Two tiers of a document at a time index: a statically pruned index
+// (mk_wand_idx -P/-G) and the full one. A query runs on the pruned tier
+// first and only falls back to the full index if the result of the tier
+// cannot be shown to be that of the full index.
+//
+// The pruned lists keep the document frequency of the full lists, so a
+// posting scores the same in both tiers, and cutoff(t) is the highest
+// score of a posting dropped from the list of t. A document which is not
+// among the top k of the tier can thus at most score
+//  - its tier score, at most the k+1-th score S of the tier, plus the
+//    cutoffs of the terms whose tier lists it is not in, which is all but
+//    one of them as it is in some tier list; or
+//  - the sum of all cutoffs if it is in no tier list.
+// The top k documents of the tier are rescored on the full index. If all
+// of them score more than the bound, they are the top k of the full index.
+// Conjunctive queries always run on the full index.
+template<class t_index>
+class tiered_index {
+public:
+  using index_type = t_index;
+  using plist_type = typename t_index::plist_type;
+  struct context_type {
+    typename t_index::context_type tier;
+    typename t_index::context_type full;
+    std::vector<doc_score> candidates;
+
+    context_type() = default;
+    context_type(const context_type&) = delete;
+    context_type& operator=(const context_type&) = delete;
+  };
+private:
+  t_index m_tier;
+  t_index m_full;
+  std::vector<double> m_cutoffs;
+private:
+  // the k best documents of the tier, the first k of its result, rescored
+  // on the full index into candidates
+  void rescore_candidates(context_type& ctx,size_t k) {
+    const auto& list = ctx.tier.res.list;
+    auto& candidates = ctx.candidates;
+    candidates.assign(list.begin(),list.begin() + std::min(k,list.size()));
+    std::sort(candidates.begin(),candidates.end(),
+              [](const doc_score& a,const doc_score& b) {
+                return a.doc_id < b.doc_id;
+              });
+    m_full.score_documents(ctx.full,candidates);
+  }
+
+  // are the k best documents of the tier, the first k of res.list, the
+  // best ones of the full index? If so they are in candidates, rescored.
+  bool first_tier_is_safe(context_type& ctx,const std::vector<query_token>& qry,
+                          size_t k) {
+    const auto& ranker = m_full.get_ranker();
+    auto& cursors = ctx.full.cursors;
+    double missing = 0;
+    double min_missing = std::numeric_limits<double>::max();
+    double max_doc_weight = 0;
+    for (size_t i=0;i<cursors.size();i++) {
+      const auto& st = cursors.state(i);
+      double cutoff = m_cutoffs[qry[cursors.term_index(i)].token_ids[0]];
+      double bound = 0;
+      if (cutoff > 0) {
+        bound = ranker.max_posting_score(cutoff,st.w_qt,st.f_t);
+      }
+      missing += bound;
+      min_missing = std::min(min_missing,bound);
+      max_doc_weight = std::max(max_doc_weight,st.max_doc_weight);
+    }
+
+    const auto& list = ctx.tier.res.list;
+    if (list.size() < k && missing > 0) {
+      // documents missing from the tier could fill the top k
+      return false;
+    }
+    double outside = missing + max_doc_weight * cursors.size();
+    if (list.size() > k) {
+      outside = std::max(outside,list[k].score + missing - min_missing);
+    }
+
+    rescore_candidates(ctx,k);
+    for (const auto& doc : ctx.candidates) {
+      if (list.size() >= k && doc.score <= outside) return false;
+    }
+    return true;
+  }
+public:
+  tiered_index() = default;
+  tiered_index(t_index&& tier,t_index&& full,std::vector<double>&& cutoffs)
+    : m_tier(std::move(tier)), m_full(std::move(full)),
+      m_cutoffs(std::move(cutoffs))
+  {
+    if (m_cutoffs.size() != m_full.postings().size() ||
+        m_tier.postings().size() != m_full.postings().size()) {
+      throw std::invalid_argument("the tiers are not of the same index.");
+    }
+  }
+
+  const t_index& tier() const { return m_tier; }
+  const t_index& full() const { return m_full; }
+
+  size_t advise_huge_pages() const {
+    return m_tier.advise_huge_pages() + m_full.advise_huge_pages();
+  }
+
+  // Runs the query on the tier, or on the full index if that is needed,
+  // and returns the result, which is that of the full index. The budget
+  // is that of the whole query: a first tier query stopped at its budget
+  // returns the top k of the tier rescored on the full index, and the
+  // full index only gets the time the tier left. The pivot limit holds
+  // for each tier, so a query may select up to twice max_pivots pivots.
+  result& search(context_type& ctx,const std::vector<query_token>& qry,
+                 size_t k,bool ranked_and = false,bool profile = false,
+                 bool t_exhaustive = false,bool ignore_low_impact = true,
+                 const query_budget& budget = query_budget()) {
+    if (!ranked_and) {
+      uint64_t start = read_cycle_counter();
+      // the tier searches the terms the full index would
+      m_full.start_query(ctx.full,qry,ignore_low_impact);
+      m_tier.start_query(ctx.tier,qry,false);
+      ctx.tier.cursors.retain_terms(ctx.full.cursors);
+      if (t_exhaustive) {
+        m_tier.process_exhaustive(ctx.tier,k+1,false,profile,budget);
+      } else {
+        m_tier.process_wand(ctx.tier,k+1,false,profile,budget);
+      }
+      auto& res = ctx.tier.res;
+      if (res.budget_stopped) rescore_candidates(ctx,k);
+      if (res.budget_stopped ||
+          (res.score_safe && first_tier_is_safe(ctx,qry,k))) {
+        res.list.assign(ctx.candidates.begin(),ctx.candidates.end());
+        std::sort(res.list.begin(),res.list.end(),std::greater<doc_score>());
+        res.first_tier = true;
+        return res;
+      }
+      query_budget rest = budget;
+      if (budget.time_us != query_budget::unlimited) {
+        double used_us = (read_cycle_counter() - start) /
+                         cycles_per_microsecond();
+        rest.time_us = (used_us < budget.time_us) ?
+                       budget.time_us - (uint64_t)used_us : 0;
+      }
+      return m_full.search(ctx.full,qry,k,false,profile,t_exhaustive,
+                           ignore_low_impact,rest);
+    }
+    return m_full.search(ctx.full,qry,k,ranked_and,profile,t_exhaustive,
+                         ignore_low_impact,budget);
+  }
+};
+
+#endif
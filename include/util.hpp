@@ -14,7 +14,9 @@
 #include <unistd.h>
 
 const std::string DICT_FILENAME = "dict.txt";
+const std::string DICT_BIN_FILENAME = "dict.bin";
 const std::string DOCNAMES_FILENAME = "doc_names.txt";
+const std::string DOCNAMES_BIN_FILENAME = "doc_names.bin";
 
 // If the maximum possible score of a term is less than this theshold, the
 // term will not be used in the score computation
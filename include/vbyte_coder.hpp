@@ -0,0 +1,64 @@
+#ifndef VBYTE_CODER_HPP
+#define VBYTE_CODER_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+struct vbyte_coder {
+
+  static size_t encode_num(uint32_t num,uint8_t* out) {
+    size_t written_bytes = 0;
+    uint8_t w = num & 0x7F;
+    num >>= 7;
+    while (num > 0) {
+      w |= 0x80; // mark overflow bit
+      *out = w;
+      ++out;
+      w = num & 0x7F;
+      num >>= 7;
+      written_bytes++;
+    }
+    *out = w;
+    ++out;
+    written_bytes++;
+    return written_bytes;
+  }
+
+  static uint32_t decode_num(const uint8_t*& in) {
+    uint32_t num = 0;
+    uint8_t w=0;
+    uint32_t shift=0;
+    do {
+      w = *in;
+      in++;    
+      num |= (((uint32_t)(w&0x7F))<<shift);
+      shift += 7;
+    } while ((w&0x80) > 0);
+    return num;
+  }
+
+  static void encode(const uint32_t* A,
+                     size_t n,
+                     uint32_t* out,
+                     size_t& written_u32s) {
+    uint8_t* out_bytes = (uint8_t*) out;
+    size_t written_bytes = 0;
+    for (size_t i=0;i<n;i++) {
+      size_t written = encode_num(A[i],out_bytes);
+      out_bytes += written;
+      written_bytes += written;
+    }
+    written_u32s = written_bytes/4;
+    if (written_bytes%4 != 0) written_u32s++;
+  }
+
+  static void decode(const uint32_t* in,size_t n,uint32_t* out) {
+    const uint8_t* in_bytes = (const uint8_t*) in;
+    for (size_t i=0;i<n;i++) {
+      *out = decode_num(in_bytes);
+      out++;
+    }
+  }
+};
+
+#endif
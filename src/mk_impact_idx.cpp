@@ -0,0 +1,265 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <unistd.h>
+
+#include "sdsl/int_vector.hpp"
+#include "block_postings_list.hpp"
+#include "rank_impact.hpp"
+#include "term_dictionary.hpp"
+#include "docno_table.hpp"
+#include "static_pruning.hpp"
+#include "util.hpp"
+
+// the postings of one term while the collection is read, doc id and impact
+using impact_postings_t = std::vector<std::pair<uint32_t,uint32_t>>;
+
+int
+main (int argc, char** argv)
+{
+  pruning_params pruning;
+  int op;
+  while ((op=getopt(argc,argv,"P:E:G:")) != -1) {
+    switch (op) {
+      case 'P':
+        pruning.top_k = std::strtoull(optarg,NULL,10);
+        break;
+      case 'E':
+        pruning.epsilon = std::strtod(optarg,NULL);
+        break;
+      case 'G':
+        pruning.global_cutoff = std::strtod(optarg,NULL);
+        break;
+    }
+  }
+  if (argc - optind != 2 || pruning.epsilon <= 0 ||
+      pruning.global_cutoff < 0) {
+    std::cout << "USAGE: " << argv[0];
+    std::cout << " [-P <k>] [-E <epsilon>] [-G <cutoff>]"
+              << " <impact file> <collection folder>" << std::endl;
+    std::cout << "  The impact file has one line per document:" << std::endl
+              << "    docno term:impact term:impact ..." << std::endl
+              << "  with integer impacts > 0, for example quantized learned"
+              << " term weights." << std::endl;
+    std::cout << "  -P, -E, -G : write a statically pruned index as"
+              << " mk_wand_idx does." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  using clock = std::chrono::high_resolution_clock;
+  using plist_type = block_postings_list<128>;
+
+  std::string impact_file_name = argv[optind];
+  std::string collection_folder = argv[optind+1];
+  create_directory(collection_folder);
+  std::string dict_file = collection_folder + "/dict.txt";
+  std::string dict_bin_file = collection_folder + "/dict.bin";
+  std::string doc_names_file = collection_folder + "/doc_names.txt";
+  std::string doc_names_bin_file = collection_folder + "/doc_names.bin";
+  std::string postings_file = collection_folder + "/WANDbl_postings.idx";
+  std::string ft_file = collection_folder + "/WANDbl_F_t.idx";
+  std::string dft_file = collection_folder + "/WANDbl_df_t.idx";
+  std::string pruned_file = collection_folder + "/WANDbl_pruned.idx";
+  std::string pruned_cutoffs_file = collection_folder +
+                                    "/WANDbl_pruned_cutoffs.idx";
+  std::string global_info_file = collection_folder + "/global.txt";
+  std::string doclen_tfile = collection_folder + "/doc_lens.txt";
+
+  auto build_start = clock::now();
+
+  std::ifstream impact_in(impact_file_name);
+  if (!impact_in.is_open()) {
+    std::cerr << "Could not open file: " << impact_file_name << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // terms get temporary ids in the order they are first seen
+  std::unordered_map<std::string,uint32_t> term_map;
+  std::vector<std::string> terms;
+  std::vector<impact_postings_t> postings;
+  std::vector<std::string> document_names;
+  std::vector<uint64_t> doc_lengths;
+  uint64_t num_terms = 0;
+
+  std::cout << "Reading impacts from " << impact_file_name << "." << std::endl;
+  std::vector<std::pair<uint32_t,uint32_t>> doc_terms;
+  std::string line;
+  for (uint64_t line_no = 1; std::getline(impact_in,line); line_no++) {
+    std::istringstream line_stream(line);
+    std::string doc_name;
+    if (!(line_stream >> doc_name)) continue;
+
+    doc_terms.clear();
+    for (std::string token; line_stream >> token;) {
+      auto sep_pos = token.rfind(':');
+      char* end = nullptr;
+      uint64_t impact = 0;
+      if (sep_pos != std::string::npos && sep_pos > 0) {
+        impact = std::strtoull(token.c_str() + sep_pos + 1,&end,10);
+      }
+      if (end == nullptr || end == token.c_str() + sep_pos + 1 || *end != '\0'
+          || impact > std::numeric_limits<uint32_t>::max()) {
+        std::cerr << "ERROR: line " << line_no << ": '" << token
+                  << "' is not term:impact." << std::endl;
+        return EXIT_FAILURE;
+      }
+      if (impact == 0) continue;
+      auto term = token.substr(0,sep_pos);
+      auto itr = term_map.find(term);
+      if (itr == term_map.end()) {
+        itr = term_map.emplace(term,terms.size()).first;
+        terms.push_back(term);
+        postings.emplace_back();
+      }
+      doc_terms.emplace_back(itr->second,impact);
+    }
+
+    // a term listed twice for a document has the sum of its impacts
+    uint32_t doc_id = document_names.size();
+    std::sort(doc_terms.begin(),doc_terms.end());
+    for (size_t i=0;i<doc_terms.size();i++) {
+      uint64_t impact = doc_terms[i].second;
+      while (i+1 < doc_terms.size() &&
+             doc_terms[i+1].first == doc_terms[i].first) {
+        impact += doc_terms[++i].second;
+      }
+      impact = std::min<uint64_t>(impact,std::numeric_limits<uint32_t>::max());
+      postings[doc_terms[i].first].emplace_back(doc_id,impact);
+    }
+    document_names.push_back(doc_name);
+    doc_lengths.push_back(doc_terms.size());
+    num_terms += doc_terms.size();
+  }
+  std::cout << "Read " << document_names.size() << " documents with "
+            << terms.size() << " distinct terms." << std::endl;
+
+  // term ids are assigned from 2 in lexicographic order, as in the
+  // dictionaries of mk_wand_idx
+  std::vector<uint32_t> order(terms.size());
+  for (size_t i=0;i<order.size();i++) order[i] = i;
+  std::sort(order.begin(),order.end(),[&](uint32_t a,uint32_t b) {
+    return terms[a] < terms[b];
+  });
+
+  std::cout << "Writing global info to " << global_info_file << "."
+            << std::endl;
+  {
+    std::ofstream of_globalinfo(global_info_file);
+    of_globalinfo << document_names.size() << " " << num_terms << std::endl;
+  }
+
+  // the number of distinct terms of a document, BM25 is not used
+  std::cout << "Writing document lengths to " << doclen_tfile << "."
+            << std::endl;
+  {
+    std::ofstream doclen_out(doclen_tfile);
+    for (auto len : doc_lengths) {
+      doclen_out << len << std::endl;
+    }
+  }
+
+  // write document names
+  {
+    std::cout << "Writing document names to " << doc_names_file << "."
+              << std::endl;
+    std::ofstream of_doc_names(doc_names_file);
+    for(const auto& doc_name : document_names) {
+      of_doc_names << doc_name << std::endl;
+    }
+    std::cout << "Writing docno table to " << doc_names_bin_file << "."
+              << std::endl;
+    std::ofstream of_doc_names_bin(doc_names_bin_file, std::ios::binary);
+    docno_table::serialize(document_names, of_doc_names_bin);
+  }
+
+  // write dictionary; the collection frequency of a term is the sum of
+  // its impacts
+  uint64_t num_lists = terms.size() + 2;
+  sdsl::int_vector<> F_t_list(num_lists);
+  sdsl::int_vector<> f_t_list(num_lists);
+  {
+    std::cout << "Writing dictionary to " << dict_file << "." << std::endl;
+    std::ofstream of_dict(dict_file);
+    std::vector<std::pair<std::string,uint64_t>> dict_entries;
+    for (size_t j=0;j<order.size();j++) {
+      const auto& post = postings[order[j]];
+      uint64_t F_t = 0;
+      for (const auto& p : post) F_t += p.second;
+      F_t_list[j+2] = F_t;
+      f_t_list[j+2] = post.size();
+      dict_entries.emplace_back(terms[order[j]],j+2);
+      of_dict << terms[order[j]] << " " << j+2 << " "
+              << post.size() << " " << F_t << " " << std::endl;
+    }
+    std::cout << "Writing binary dictionary to " << dict_bin_file << "."
+              << std::endl;
+    std::ofstream of_dict_bin(dict_bin_file, std::ios::binary);
+    term_dictionary::serialize(std::move(dict_entries), of_dict_bin);
+  }
+
+  // write inverted files; lists are compressed and written one at a time
+  {
+    my_rank_impact ranker(doc_lengths, num_terms);
+    std::vector<std::pair<uint64_t,uint64_t>> post;
+    std::vector<double> pruned_cutoffs;
+    pruning_stats stats;
+
+    std::ofstream ofs(postings_file);
+    std::ofstream pruned_ofs;
+    std::cout << "Writing " << num_lists << " postings lists." << std::endl;
+    size_t postings_bytes = sdsl::serialize(num_lists, ofs);
+    size_t pruned_bytes = 0;
+    if (pruning.enabled()) {
+      pruned_ofs.open(pruned_file);
+      pruned_bytes = sdsl::serialize(num_lists, pruned_ofs);
+      pruned_cutoffs.resize(num_lists,0);
+    }
+    for (size_t j=0;j<num_lists;j++) {
+      post.clear();
+      if (j >= 2) {
+        auto& term_post = postings[order[j-2]];
+        post.assign(term_post.begin(),term_post.end());
+        impact_postings_t().swap(term_post);
+      }
+      plist_type pl;
+      if (!post.empty()) pl = plist_type(ranker, post);
+      postings_bytes += sdsl::serialize(pl, ofs);
+      if (pruning.enabled()) {
+        plist_type pruned_pl;
+        pruned_cutoffs[j] = prune_list(post,ranker,pruning,stats,pruned_pl);
+        pruned_bytes += sdsl::serialize(pruned_pl, pruned_ofs);
+      }
+    }
+
+    std::cout << "Writing F_t lists." << std::endl;
+    std::ofstream Ft(ft_file);
+    F_t_list.serialize(Ft);
+
+    std::cout << "Writing f_t lists." << std::endl;
+    std::ofstream ft(dft_file);
+    f_t_list.serialize(ft);
+
+    if (pruning.enabled()) {
+      write_pruning_cutoffs(pruned_cutoffs,pruned_cutoffs_file);
+      stats.print(std::cout);
+      std::cout << "Pruned postings take " << pruned_bytes / (1024*1024)
+                << " MiB, " << 100.0 * pruned_bytes / postings_bytes
+                << "% of the " << postings_bytes / (1024*1024)
+                << " MiB of all postings." << std::endl;
+    }
+  }
+
+  auto build_stop = clock::now();
+  auto build_time_sec = std::chrono::duration_cast<std::chrono::seconds>(build_stop-build_start);
+  std::cout << "Index built in " << build_time_sec.count() << " seconds." << std::endl;
+
+  return (EXIT_SUCCESS);
+}
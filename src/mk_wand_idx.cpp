@@ -1,57 +1,85 @@
 #include <iostream>
+#include <unistd.h>
 
 #include "indri/Repository.hpp"
 #include "indri/CompressedCollection.hpp"
 #include "sdsl/int_vector_buffer.hpp"
 #include "include/block_postings_list.hpp"
 #include "include/bm25.hpp"
+#include "include/term_dictionary.hpp"
+#include "include/docno_table.hpp"
+#include "include/impact_index.hpp"
+#include "include/pareto_bounds.hpp"
+#include "include/static_pruning.hpp"
+#include "include/util.hpp"
 
 
 #define INIT_SZ 4096 
 
-bool
-directory_exists(std::string dir)
-{
-  struct stat sb;
-  const char* pathname = dir.c_str();
-  if (stat(pathname, &sb) == 0 && S_ISDIR(sb.st_mode)) {
-    return true;
-  }
-  return false;
-}
-
-void
-create_directory(std::string dir)
-{
-  if (!directory_exists(dir)) {
-    if (mkdir(dir.c_str(),0777) == -1) {
-      perror("could not create directory");
-      exit(EXIT_FAILURE);
-    }
-  }
-}
-
-
 int 
 main (int argc, char** argv) 
 {
-  if (argc != 3) {
+  bool build_impact = false;
+  uint32_t impact_bits = 8;
+  pruning_params pruning;
+  int op;
+  while ((op=getopt(argc,argv,"IQ:P:E:G:")) != -1) {
+    switch (op) {
+      case 'I':
+        build_impact = true;
+        break;
+      case 'Q':
+        impact_bits = std::strtoul(optarg,NULL,10);
+        break;
+      case 'P':
+        pruning.top_k = std::strtoull(optarg,NULL,10);
+        break;
+      case 'E':
+        pruning.epsilon = std::strtod(optarg,NULL);
+        break;
+      case 'G':
+        pruning.global_cutoff = std::strtod(optarg,NULL);
+        break;
+    }
+  }
+  if (argc - optind != 2 || impact_bits < 2 || impact_bits > 16 ||
+      pruning.epsilon <= 0 || pruning.global_cutoff < 0) {
     std::cout << "USAGE: " << argv[0];
-    std::cout << " <indri repository> <collection folder>" << std::endl;
+    std::cout << " [-I] [-Q <bits>] [-P <k>] [-E <epsilon>] [-G <cutoff>]"
+              << " <indri repository> <collection folder>" << std::endl;
+    std::cout << "  -I : also write the impact ordered index used by"
+              << " wand_search -s." << std::endl;
+    std::cout << "  -Q <bits> : impact quantization bits (2-16, default 8)."
+              << std::endl;
+    std::cout << "  -P <k> : also write a statically pruned index used by"
+              << " wand_search -p, keeping" << std::endl
+              << "           the postings scoring at least epsilon times the"
+              << " k-th best score of their list." << std::endl;
+    std::cout << "  -E <epsilon> : the fraction of -P (> 0, default 1)."
+              << std::endl;
+    std::cout << "  -G <cutoff> : prune the postings scoring below cutoff in"
+              << " all lists." << std::endl;
         return EXIT_FAILURE;
   }
 
   using clock = std::chrono::high_resolution_clock;
 
   // parse cmd line
-  std::string repository_name = argv[1];
-  std::string collection_folder = argv[2];
+  std::string repository_name = argv[optind];
+  std::string collection_folder = argv[optind+1];
   create_directory(collection_folder);
   std::string dict_file = collection_folder + "/dict.txt";
+  std::string dict_bin_file = collection_folder + "/dict.bin";
   std::string doc_names_file = collection_folder + "/doc_names.txt";
+  std::string doc_names_bin_file = collection_folder + "/doc_names.bin";
   std::string postings_file = collection_folder + "/WANDbl_postings.idx";
   std::string ft_file = collection_folder + "/WANDbl_F_t.idx";
   std::string dft_file = collection_folder + "/WANDbl_df_t.idx";
+  std::string impact_file = collection_folder + "/WANDbl_impact.idx";
+  std::string pruned_file = collection_folder + "/WANDbl_pruned.idx";
+  std::string pruned_cutoffs_file = collection_folder +
+                                    "/WANDbl_pruned_cutoffs.idx";
+  std::string pareto_file = collection_folder + "/WANDbl_pareto.idx";
   std::string global_info_file = collection_folder + "/global.txt";
   std::string doclen_tfile = collection_folder + "/doc_lens.txt";
 
@@ -113,6 +141,10 @@ main (int argc, char** argv)
     for(const auto& doc_name : document_names) {
       of_doc_names << doc_name << std::endl;
     }
+    std::cout << "Writing docno table to " << doc_names_bin_file << "."
+              << std::endl;
+    std::ofstream of_doc_names_bin(doc_names_bin_file, std::ios::binary);
+    docno_table::serialize(document_names, of_doc_names_bin);
   }
 
   // write dictionary
@@ -124,12 +156,14 @@ main (int argc, char** argv)
     indri::index::VocabularyIterator* iter = index->vocabularyIterator();
     iter->startIteration();
 
+    std::vector<std::pair<std::string,uint64_t>> dict_entries;
     size_t j = 2;
     while( !iter->finished() ) {
       indri::index::DiskTermData* entry = iter->currentEntry();
       indri::index::TermData* termData = entry->termData;
 
       map.emplace(termData->term, j);
+      dict_entries.emplace_back(termData->term, j);
 
       of_dict << termData->term << " " << j << " "
               << termData->corpus.documentCount << " "
@@ -140,6 +174,11 @@ main (int argc, char** argv)
       j++;
     }
     delete iter;
+
+    std::cout << "Writing binary dictionary to " << dict_bin_file << "."
+              << std::endl;
+    std::ofstream of_dict_bin(dict_bin_file, std::ios::binary);
+    term_dictionary::serialize(std::move(dict_entries), of_dict_bin);
   }
 
 
@@ -148,6 +187,10 @@ main (int argc, char** argv)
   {
     using plist_type = block_postings_list<128>;
     vector<plist_type> m_postings_lists; 
+    vector<plist_type> m_pruned_lists;
+    vector<double> m_pruned_cutoffs;
+    pruning_stats m_pruning_stats;
+    vector<pareto_bounds::pareto_set> m_pareto_sets;
     uint64_t a = 0, b = 0;
     uint64_t n_terms = index->uniqueTermCount();
 
@@ -170,6 +213,11 @@ main (int argc, char** argv)
     std::cerr << "Writing postings lists ..." << std::endl;
 
     m_postings_lists.resize(n_terms + 2);
+    if (pruning.enabled()) {
+      m_pruned_lists.resize(n_terms + 2);
+      m_pruned_cutoffs.resize(n_terms + 2,0);
+    }
+    m_pareto_sets.resize(n_terms + 2);
     my_rank_bm25<90,40> ranker(doc_lengths, num_terms);
     sdsl::int_vector<> F_t_list(n_terms + 2);
     sdsl::int_vector<> f_t_list(n_terms + 2);
@@ -199,15 +247,22 @@ main (int argc, char** argv)
       }
       plist_type pl(ranker, post);
       m_postings_lists[map[termData->term]] = pl;
+      m_pareto_sets[map[termData->term]] =
+        pareto_bounds::make_set(post,doc_lengths);
+      if (pruning.enabled()) {
+        m_pruned_cutoffs[map[termData->term]] =
+          prune_list(post,ranker,pruning,m_pruning_stats,
+                     m_pruned_lists[map[termData->term]]);
+      }
       iter->nextEntry();
     }
     delete iter;
 
     size_t num_lists = m_postings_lists.size();
     cout << "Writing " << num_lists << " postings lists." << endl;
-    sdsl::serialize(num_lists, ofs);
+    size_t postings_bytes = sdsl::serialize(num_lists, ofs);
     for(const auto& pl : m_postings_lists) {
-      sdsl::serialize(pl, ofs);
+      postings_bytes += sdsl::serialize(pl, ofs);
     }
   
     //Write F_t data to file, skip 0 and 1
@@ -218,10 +273,44 @@ main (int argc, char** argv)
     cout << "Writing f_t lists." << endl;
     f_t_list.serialize(ft);
 
+    // the list maxima of wand_search -K are computed from these
+    cout << "Writing Pareto sets of (f_dt,W_d) to " << pareto_file << "."
+         << endl;
+    {
+      std::ofstream pareto_ofs(pareto_file);
+      pareto_bounds(m_pareto_sets).serialize(pareto_ofs);
+      vector<pareto_bounds::pareto_set>().swap(m_pareto_sets);
+    }
+
     //close output files
     post_file.close();
     F_t_file.close();
     f_t_file.close();
+
+    if (pruning.enabled()) {
+      cout << "Writing pruned postings lists to " << pruned_file << "."
+           << endl;
+      std::ofstream pruned_ofs(pruned_file);
+      size_t pruned_bytes = sdsl::serialize(num_lists, pruned_ofs);
+      for(const auto& pl : m_pruned_lists) {
+        pruned_bytes += sdsl::serialize(pl, pruned_ofs);
+      }
+      write_pruning_cutoffs(m_pruned_cutoffs,pruned_cutoffs_file);
+      m_pruning_stats.print(cout);
+      cout << "Pruned postings take " << pruned_bytes / (1024*1024)
+           << " MiB, " << 100.0 * pruned_bytes / postings_bytes
+           << "% of the " << postings_bytes / (1024*1024) << " MiB of all"
+           << " postings." << endl;
+    }
+
+    if (build_impact) {
+      cout << "Writing impact ordered index (" << impact_bits << " bits)."
+           << endl;
+      idx_impact impact_index(m_postings_lists,ranker,doc_lengths.size(),
+                              impact_bits);
+      std::ofstream impact_ofs(impact_file);
+      impact_index.serialize(impact_ofs);
+    }
   }
 
   auto build_stop = clock::now();
@@ -0,0 +1,476 @@
+#include <unistd.h>
+#include <stdlib.h>
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <random>
+
+#include "query.hpp"
+#include "invidx.hpp"
+#include "bm25.hpp"
+#include "synthetic_index.hpp"
+
+typedef struct cmdargs {
+    uint64_t num_docs;
+    uint64_t vocab_size;
+    double zipf_s;
+    uint64_t repetitions;
+    uint64_t seed;
+    bool huge_pages;
+    bool dense_lists;
+} cmdargs_t;
+
+void
+print_usage (char* program)
+{
+  fprintf(stdout,"%s [-n <docs>] [-t <terms>] [-z <s>] [-r <reps>]",program);
+  fprintf(stdout," [-s <seed>] [-H] [-D]\n");
+  fprintf(stdout,"where\n");
+  fprintf(stdout,"  -n <docs>  : number of synthetic documents.\n");
+  fprintf(stdout,"  -t <terms> : vocabulary size.\n");
+  fprintf(stdout,"  -z <s>     : zipf exponent of the document frequencies.\n");
+  fprintf(stdout,"  -r <reps>  : repetitions of each measurement.\n");
+  fprintf(stdout,"  -s <seed>  : random seed.\n");
+  fprintf(stdout,"  -H         : back the postings with transparent huge pages.\n");
+  fprintf(stdout,"  -D         : never store the ids of dense lists as bitmaps.\n");
+  exit(EXIT_FAILURE);
+};
+
+cmdargs_t
+parse_args(int argc,char* const argv[])
+{
+  cmdargs_t args;
+  int op;
+  args.num_docs = 1000000;
+  args.vocab_size = 20000;
+  args.zipf_s = 1.0;
+  args.repetitions = 5;
+  args.seed = 4711;
+  args.huge_pages = false;
+  args.dense_lists = true;
+  while ((op=getopt(argc,argv,"n:t:z:r:s:HD")) != -1) {
+    switch (op) {
+      case 'n':
+        args.num_docs = std::strtoull(optarg,NULL,10);
+        break;
+      case 't':
+        args.vocab_size = std::strtoull(optarg,NULL,10);
+        break;
+      case 'z':
+        args.zipf_s = std::strtod(optarg,NULL);
+        break;
+      case 'r':
+        args.repetitions = std::strtoull(optarg,NULL,10);
+        break;
+      case 's':
+        args.seed = std::strtoull(optarg,NULL,10);
+        break;
+      case 'H':
+        args.huge_pages = true;
+        break;
+      case 'D':
+        args.dense_lists = false;
+        break;
+      case '?':
+      default:
+        print_usage(argv[0]);
+    }
+  }
+  if (args.num_docs == 0 || args.vocab_size == 0 || args.repetitions == 0) {
+    std::cerr << "Invalid command line parameters.\n";
+    print_usage(argv[0]);
+  }
+  return args;
+}
+
+using plist_type = block_postings_list<128>;
+using ranker_type = my_rank_bm25<>;
+using my_index_t = idx_invfile<plist_type,ranker_type>;
+using clock_type = std::chrono::high_resolution_clock;
+
+// sink for benchmark results so the compiler can not drop the work
+volatile uint64_t g_sink = 0;
+
+// run f() reps times and return the fastest run in nanoseconds
+template<class t_func>
+double
+best_of(size_t reps,t_func f)
+{
+  double best = std::numeric_limits<double>::max();
+  for (size_t i=0;i<reps;i++) {
+    auto start = clock_type::now();
+    f();
+    auto stop = clock_type::now();
+    double ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                  stop-start).count();
+    best = std::min(best,ns);
+  }
+  return best;
+}
+
+void
+report(const std::string& name,const std::string& param,double ns,
+       uint64_t ops,const std::string& unit)
+{
+  std::cout << std::left << std::setw(28) << name
+            << std::setw(14) << param
+            << std::right << std::setw(12) << std::fixed
+            << std::setprecision(3) << ns / std::max<uint64_t>(ops,1)
+            << " " << unit << std::endl;
+}
+
+void
+bench_vbyte(const cmdargs_t& args)
+{
+  // tail blocks are vbyte coded gaps
+  const size_t n = 127;
+  const size_t num_blocks = 4096;
+  std::mt19937_64 gen(args.seed);
+  std::geometric_distribution<uint32_t> gaps(0.01);
+  std::vector<uint32_t> input(n);
+  std::vector<uint32_t> encoded(num_blocks * (2*n+4));
+  std::vector<size_t> offsets(num_blocks);
+  size_t offset = 0;
+  for (size_t b=0;b<num_blocks;b++) {
+    for (auto& x : input) x = gaps(gen);
+    size_t written_u32s = 0;
+    vbyte_coder::encode(input.data(),n,encoded.data()+offset,written_u32s);
+    offsets[b] = offset;
+    offset += written_u32s;
+  }
+  std::vector<uint32_t> output(n);
+  auto ns = best_of(args.repetitions,[&]() {
+    for (size_t b=0;b<num_blocks;b++) {
+      vbyte_coder::decode(encoded.data()+offsets[b],n,output.data());
+      g_sink += output[n-1];
+    }
+  });
+  report("vbyte_coder::decode","n=127",ns,num_blocks*n,"ns/posting");
+}
+
+void
+bench_decompress(const cmdargs_t& args,const std::vector<plist_type>& lists)
+{
+  plist_type::pfor_data_type ids;
+  plist_type::pfor_data_type freqs;
+  uint64_t postings = 0;
+  for (const auto& pl : lists) postings += pl.size();
+  auto ns = best_of(args.repetitions,[&]() {
+    for (const auto& pl : lists) {
+      for (size_t b=0;b<pl.num_blocks();b++) {
+        pl.decompress_block(b,ids,freqs);
+        g_sink += ids[0];
+      }
+    }
+  });
+  report("decompress_block","all",ns,postings,"ns/posting");
+}
+
+void
+bench_traversal(const cmdargs_t& args,const std::vector<plist_type>& lists)
+{
+  uint64_t postings = 0;
+  for (const auto& pl : lists) postings += pl.size();
+  auto ns = best_of(args.repetitions,[&]() {
+    for (const auto& pl : lists) {
+      auto itr = pl.begin();
+      auto end = pl.end();
+      uint64_t sum = 0;
+      while (itr != end) {
+        sum += itr.docid() + itr.freq();
+        ++itr;
+      }
+      g_sink += sum;
+    }
+  });
+  report("plist_iterator::operator++","all",ns,postings,"ns/posting");
+}
+
+void
+bench_skip(const cmdargs_t& args,const std::vector<plist_type>& lists)
+{
+  // decode the lists once to obtain the skip targets
+  std::vector<std::vector<uint64_t>> ids(lists.size());
+  for (size_t i=0;i<lists.size();i++) {
+    for (auto itr = lists[i].begin();itr != lists[i].end();++itr) {
+      ids[i].push_back(itr.docid());
+    }
+  }
+  for (size_t dist : {1,4,16,64,256,1024,4096}) {
+    uint64_t skips = 0;
+    for (const auto& l : ids) skips += l.size() / dist;
+    if (skips == 0) continue;
+    auto ns = best_of(args.repetitions,[&]() {
+      for (size_t i=0;i<lists.size();i++) {
+        auto itr = lists[i].begin();
+        g_sink += itr.docid(); // positions the iterator on the first block
+        for (size_t j=dist;j<ids[i].size();j+=dist) {
+          itr.skip_to_id(ids[i][j]);
+          g_sink += itr.docid();
+        }
+      }
+    });
+    report("plist_iterator::skip_to_id","d="+std::to_string(dist),
+           ns,skips,"ns/skip");
+  }
+}
+
+void
+bench_find_block(const cmdargs_t& args,const std::vector<plist_type>& lists)
+{
+  for (size_t dist : {1,8,64}) {
+    uint64_t ops = 0;
+    for (const auto& pl : lists) ops += pl.num_blocks() / dist;
+    if (ops == 0) continue;
+    auto ns = best_of(args.repetitions,[&]() {
+      for (const auto& pl : lists) {
+        size_t cur = 0;
+        for (size_t b=dist;b<pl.num_blocks();b+=dist) {
+          cur = pl.find_block_with_id(pl.block_rep(b),cur);
+          g_sink += cur;
+        }
+      }
+    });
+    report("find_block_with_id","blocks="+std::to_string(dist),
+           ns,ops,"ns/skip");
+  }
+}
+
+void
+bench_docscore(const cmdargs_t& args,const synthetic_collection& col)
+{
+  ranker_type ranker(col.doc_lengths,col.num_terms,col.num_docs);
+  const auto& pl = col.postings[0];
+  double f_t = pl.size();
+  auto ns = best_of(args.repetitions,[&]() {
+    double sum = 0;
+    for (const auto& p : pl) {
+      double W_d = ranker.doc_length(p.first);
+      sum += ranker.calculate_docscore(1.0,p.second,f_t,W_d,true);
+    }
+    g_sink += (uint64_t)sum;
+  });
+  report("calculate_docscore","f_t="+std::to_string(pl.size()),
+         ns,pl.size(),"ns/posting");
+
+  double w_qt = ranker.query_term_weight(1.0,f_t);
+  ns = best_of(args.repetitions,[&]() {
+    double sum = 0;
+    for (const auto& p : pl) {
+      sum += ranker.posting_score(w_qt,p.second,p.first);
+    }
+    g_sink += (uint64_t)sum;
+  });
+  report("posting_score","f_t="+std::to_string(pl.size()),
+         ns,pl.size(),"ns/posting");
+}
+
+void
+bench_pivot(const cmdargs_t& args,my_index_t& index,
+            const synthetic_collection& col)
+{
+  for (size_t terms : {2,4,8}) {
+    auto queries = make_synthetic_queries(col,20,terms,64,args.seed+terms);
+    for (bool exhaustive : {true,false}) {
+      uint64_t pivots = 0;
+      auto ns = best_of(args.repetitions,[&]() {
+        pivots = 0;
+        for (const auto& q : queries) {
+          auto res = index.search(std::get<1>(q),10,false,true,
+                                  exhaustive,false);
+          pivots += res.postings_evaluated;
+          g_sink += res.list.size();
+        }
+      });
+      std::string name = exhaustive ? "evaluate_pivot (exhaustive)"
+                                    : "evaluate_pivot (wand)";
+      report(name,"|q|="+std::to_string(terms),ns,pivots,"ns/pivot");
+    }
+  }
+}
+
+// long queries, such as expanded or learned sparse ones, with WAND,
+// MaxScore, which wand processing switches to above max_wand_terms, and
+// exhaustively
+void
+bench_long_queries(const cmdargs_t& args,my_index_t& index,
+                   const synthetic_collection& col)
+{
+  for (size_t terms : {10,50,200}) {
+    auto queries = make_synthetic_queries(col,20,terms,
+                                          std::max<size_t>(4*terms,256),
+                                          args.seed+terms);
+    my_index_t::context_type ctx;
+    for (const std::string name : {"wand","maxscore","exhaustive"}) {
+      query_budget budget;
+      budget.max_wand_terms = (name == "wand") ? terms : 0;
+      bool exhaustive = (name == "exhaustive");
+      auto ns = best_of(args.repetitions,[&]() {
+        for (const auto& q : queries) {
+          auto& res = index.search(ctx,std::get<1>(q),10,false,false,
+                                   exhaustive,false,budget);
+          g_sink += res.list.size();
+        }
+      });
+      report(name+" (long query)","|q|="+std::to_string(terms),ns,
+             queries.size(),"ns/query");
+    }
+  }
+}
+
+// the same long list workloads with and without prefetching the next block
+void
+bench_prefetch(const cmdargs_t& args,const std::vector<plist_type>& lists,
+               my_index_t& index,const synthetic_collection& col)
+{
+  uint64_t postings = 0;
+  for (const auto& pl : lists) postings += pl.size();
+  // queries of the most frequent terms only
+  std::vector<std::vector<query_token>> queries;
+  for (size_t t=0;t+1<std::min<size_t>(16,col.postings.size());t+=2) {
+    std::vector<query_token> qry;
+    for (size_t j=t;j<t+2;j++) {
+      qry.emplace_back(std::vector<uint64_t>(1,j),
+                       std::vector<std::string>(),1);
+    }
+    queries.push_back(qry);
+  }
+  my_index_t::context_type ctx;
+  for (bool prefetch : {false,true}) {
+    ctx.prefetch_next_block = prefetch;
+    std::string param = prefetch ? "prefetch" : "no prefetch";
+    auto ns = best_of(args.repetitions,[&]() {
+      for (const auto& pl : lists) {
+        uint64_t sum = 0;
+        auto end = pl.end();
+        auto itr = pl.begin();
+        itr.prefetch_next_block(prefetch);
+        for (; itr != end; ++itr) {
+          sum += itr.docid();
+        }
+        g_sink += sum;
+      }
+    });
+    report("operator++ (long lists)",param,ns,postings,"ns/posting");
+    uint64_t skips = 0;
+    ns = best_of(args.repetitions,[&]() {
+      skips = 0;
+      for (const auto& pl : lists) {
+        auto itr = pl.begin();
+        auto end = pl.end();
+        itr.prefetch_next_block(prefetch);
+        uint64_t id = itr.docid();
+        while (itr != end) {
+          id += 512;
+          itr.skip_to_id(id);
+          skips++;
+        }
+        g_sink += skips;
+      }
+    });
+    report("skip_to_id (+512 ids)",param,ns,skips,"ns/skip");
+    uint64_t pivots = 0;
+    ns = best_of(args.repetitions,[&]() {
+      pivots = 0;
+      for (const auto& qry : queries) {
+        auto& res = index.search(ctx,qry,10,false,true,false,false);
+        pivots += res.postings_evaluated;
+      }
+    });
+    report("wand (long lists)",param,ns,pivots,"ns/pivot");
+  }
+}
+
+// bursts of queries evaluated one by one and as batches sharing the
+// decoded blocks of common terms, with much (top 32 terms) and little
+// (top 2048 terms) overlap between the queries
+void
+bench_batch(const cmdargs_t& args,my_index_t& index,
+            const synthetic_collection& col)
+{
+  for (size_t max_rank : {32,2048}) {
+    auto queries = make_synthetic_queries(col,64,3,max_rank,
+                                          args.seed+max_rank);
+    std::string overlap = "top"+std::to_string(max_rank);
+    my_index_t::context_type ctx;
+    auto ns = best_of(args.repetitions,[&]() {
+      for (const auto& q : queries) {
+        g_sink += index.search(ctx,std::get<1>(q),10).list.size();
+      }
+    });
+    report("search (one by one)",overlap,ns,queries.size(),"ns/query");
+    for (size_t batch_size : {8,64}) {
+      my_index_t::batch_context_type bctx;
+      std::vector<const std::vector<query_token>*> batch;
+      uint64_t decodes = 0, requests = 0;
+      ns = best_of(args.repetitions,[&]() {
+        decodes = requests = 0;
+        for (size_t b=0;b<queries.size();b+=batch_size) {
+          batch.clear();
+          for (size_t q=b;q<std::min(b+batch_size,queries.size());q++) {
+            batch.push_back(&std::get<1>(queries[q]));
+          }
+          index.search_batch(bctx,batch,10);
+          g_sink += bctx.res(0).list.size();
+          decodes += bctx.shared.decodes();
+          requests += bctx.shared.requests();
+        }
+      });
+      report("search_batch (b="+std::to_string(batch_size)+")",overlap,ns,
+             queries.size(),"ns/query");
+      std::cout << "  shared blocks decoded " << decodes << " of "
+                << requests << " requested" << std::endl;
+    }
+  }
+}
+
+int
+main (int argc,char* const argv[])
+{
+  cmdargs_t args = parse_args(argc,argv);
+
+  std::cout << "Generating synthetic collection with " << args.num_docs
+            << " documents and " << args.vocab_size << " terms." << std::endl;
+  auto col = make_zipf_collection(args.num_docs,args.vocab_size,
+                                  args.zipf_s,0.3,args.seed);
+  my_index_t index;
+  construct_synthetic(index,col,args.dense_lists);
+
+  // long lists dominate query cost; benchmark the 32 most frequent terms
+  ranker_type ranker(col.doc_lengths,col.num_terms,col.num_docs);
+  std::vector<plist_type> long_lists;
+  for (size_t t=0;t<std::min<size_t>(32,col.postings.size());t++) {
+    long_lists.emplace_back(ranker,col.postings[t],args.dense_lists);
+  }
+  size_t dense = 0, id_bytes = 0;
+  for (const auto& pl : long_lists) {
+    dense += pl.view().dense;
+    id_bytes += pl.view().id_u32s * sizeof(uint32_t);
+  }
+  std::cout << dense << " of the " << long_lists.size() << " longest lists"
+            << " are dense, their ids take " << id_bytes / 1024 << " KiB."
+            << std::endl;
+
+  if (args.huge_pages) {
+    size_t bytes = index.advise_huge_pages();
+    for (const auto& pl : long_lists) bytes += pl.advise_huge_pages();
+    std::cout << "Advised " << bytes / (1024*1024)
+              << " MiB of postings to use huge pages." << std::endl;
+  }
+
+  std::cout << std::left << std::setw(28) << "benchmark"
+            << std::setw(14) << "param"
+            << std::right << std::setw(12) << "time" << std::endl;
+  bench_vbyte(args);
+  bench_decompress(args,long_lists);
+  bench_traversal(args,long_lists);
+  bench_skip(args,long_lists);
+  bench_find_block(args,long_lists);
+  bench_docscore(args,col);
+  bench_pivot(args,index,col);
+  bench_long_queries(args,index,col);
+  bench_prefetch(args,long_lists,index,col);
+  bench_batch(args,index,col);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,416 @@
+#include <unistd.h>
+#include <stdlib.h>
+#include <iostream>
+#include <iomanip>
+#include <atomic>
+#include <random>
+#include <sstream>
+#include <thread>
+
+#include "query.hpp"
+#include "invidx.hpp"
+#include "bm25.hpp"
+#include "latency_histogram.hpp"
+#include "concurrent_queue.hpp"
+#include "impact_index.hpp"
+#include "index_loader.hpp"
+
+// Open-loop load generator. Queries of a query log arrive at the index as
+// a Poisson process of a given rate, independent of how fast they are
+// answered, and are served by a pool of worker threads from one queue.
+// Latencies are measured from the time a query was scheduled to arrive, so
+// time spent waiting in the queue (or behind a late dispatcher) counts
+// and there is no coordinated omission.
+
+typedef struct cmdargs {
+    std::string collection_dir;
+    std::string query_file;
+    collection_files files;
+    std::string output_prefix;
+    bool ignore_low_impact_terms;
+    bool is_exhaustive;
+    bool is_saat;
+    query_budget budget;
+    uint64_t k;
+    std::vector<double> rates;
+    double duration_sec;
+    uint64_t warmup_runs;
+    uint64_t num_threads;
+    uint64_t max_backlog;
+    uint64_t seed;
+} cmdargs_t;
+
+void
+print_usage (char* program)
+{
+  fprintf(stdout,"%s -c <collection> -q <query log> -R <rates>",program);
+  fprintf(stdout," -o <output>\n");
+  fprintf(stdout,"where\n");
+  fprintf(stdout,"  -c <collection>  : the collection directory.\n");
+  fprintf(stdout,"  -q <query log>  : the queries to replay, in order.\n");
+  fprintf(stdout,"  -R <rates> : comma separated arrival rates in queries");
+  fprintf(stdout," per second.\n");
+  fprintf(stdout,"  -d <seconds> : arrivals per rate, default 10.\n");
+  fprintf(stdout,"  -T <threads> : worker threads.\n");
+  fprintf(stdout,"  -k <top-k>  : the number of documents to be retrieved.\n");
+  fprintf(stdout,"  -o <output> : prefix for output files.\n");
+  fprintf(stdout,"  -e   : turn on exhaustive processing, defaults to wand.\n");
+  fprintf(stdout,"  -s   : score-at-a-time processing of the impact ordered");
+  fprintf(stdout," index (mk_wand_idx -I).\n");
+  fprintf(stdout,"  -t <us> : time budget per query in microseconds.\n");
+  fprintf(stdout,"  -b <work> : work budget per query, pivots (postings");
+  fprintf(stdout," for -s).\n");
+  fprintf(stdout,"  -i   : don't ignore terms where max impact < threshold,");
+  fprintf(stdout," default is to ignore.\n");
+  fprintf(stdout,"  -w <runs>   : warm-up passes over the queries (not timed).\n");
+  fprintf(stdout,"  -m <queries> : give up on a rate once this many queries");
+  fprintf(stdout," are outstanding, default 100000.\n");
+  fprintf(stdout,"  -x <seed> : seed of the arrival process.\n");
+  exit(EXIT_FAILURE);
+};
+
+cmdargs_t
+parse_args(int argc,char* const argv[])
+{
+  cmdargs_t args;
+  int op;
+  args.collection_dir = "";
+  args.output_prefix = "wand";
+  args.is_exhaustive = false;
+  args.is_saat = false;
+  args.ignore_low_impact_terms = true;
+  args.k = 10;
+  args.duration_sec = 10;
+  args.warmup_runs = 1;
+  args.num_threads = std::max(1U,std::thread::hardware_concurrency());
+  args.max_backlog = 100000;
+  args.seed = 4711;
+  while ((op=getopt(argc,argv,"c:q:R:d:T:k:o:esit:b:w:m:x:")) != -1) {
+    switch (op) {
+      case 'c':
+        args.collection_dir = optarg;
+        args.files = collection_files(args.collection_dir);
+        break;
+      case 'q':
+        args.query_file = optarg;
+        break;
+      case 'R': {
+          std::stringstream ss(optarg);
+          std::string rate;
+          while (std::getline(ss,rate,',')) {
+            if (!rate.empty()) args.rates.push_back(std::strtod(rate.c_str(),NULL));
+          }
+        }
+        break;
+      case 'd':
+        args.duration_sec = std::strtod(optarg,NULL);
+        break;
+      case 'T':
+        args.num_threads = std::strtoul(optarg,NULL,10);
+        break;
+      case 'k':
+        args.k = std::strtoul(optarg,NULL,10);
+        break;
+      case 'o':
+        args.output_prefix = optarg;
+        break;
+      case 'e':
+        args.is_exhaustive = true;
+        break;
+      case 's':
+        args.is_saat = true;
+        break;
+      case 'i':
+        args.ignore_low_impact_terms = false;
+        break;
+      case 't':
+        args.budget.time_us = std::strtoull(optarg,NULL,10);
+        break;
+      case 'b':
+        args.budget.max_pivots = std::strtoull(optarg,NULL,10);
+        break;
+      case 'w':
+        args.warmup_runs = std::strtoul(optarg,NULL,10);
+        break;
+      case 'm':
+        args.max_backlog = std::strtoull(optarg,NULL,10);
+        break;
+      case 'x':
+        args.seed = std::strtoull(optarg,NULL,10);
+        break;
+      case '?':
+      default:
+        print_usage(argv[0]);
+    }
+  }
+  if (args.collection_dir==""||args.query_file==""||args.rates.empty()) {
+    std::cerr << "Missing command line parameters.\n";
+    print_usage(argv[0]);
+  }
+  for (auto rate : args.rates) {
+    if (rate <= 0) {
+      std::cerr << "Arrival rates must be positive.\n";
+      print_usage(argv[0]);
+    }
+  }
+  if (args.num_threads == 0 || args.duration_sec <= 0) {
+    std::cerr << "Need at least one thread and a positive duration.\n";
+    print_usage(argv[0]);
+  }
+  return args;
+}
+
+using clock_type = std::chrono::steady_clock;
+
+// a query of the log and the time it is scheduled to arrive; warm-up
+// queries are not timed
+struct arrival {
+  size_t query;
+  clock_type::time_point scheduled;
+  bool timed;
+};
+
+// latencies in microseconds recorded by one worker
+struct worker_stats {
+  log_linear_histogram<> latency;  // scheduled arrival to completion
+  log_linear_histogram<> queueing; // scheduled arrival to start of search
+  log_linear_histogram<> service;  // search
+  uint64_t budget_hits = 0;
+  clock_type::time_point last_completion;
+};
+
+struct rate_stats {
+  double offered_qps = 0;
+  double achieved_qps = 0;
+  uint64_t issued = 0;
+  bool overloaded = false;
+  double mean_dispatch_lag_us = 0;
+  worker_stats total;
+};
+
+// Wait until t. Sleeping is only accurate to tens of microseconds, so the
+// last stretch is spun, which keeps the arrivals of high rates on schedule
+// at the cost of the dispatcher's core.
+void
+wait_until(clock_type::time_point t)
+{
+  const auto spin = std::chrono::microseconds(200);
+  auto now = clock_type::now();
+  if (t - now > spin) std::this_thread::sleep_until(t - spin);
+  while (clock_type::now() < t) { }
+}
+
+int
+main (int argc,char* const argv[])
+{
+  /* define types */
+  using plist_type = block_postings_list<128>;
+  using my_index_t = idx_invfile<plist_type,my_rank_bm25<> >;
+  /* parse command line */
+  cmdargs_t args = parse_args(argc,argv);
+
+  /* parse queries */
+  std::cout << "Parsing query file '" << args.query_file << "'" << std::endl;
+  auto queries = query_parser::parse_queries(args.collection_dir,args.query_file);
+  std::cout << "Found " << queries.size() << " queries." << std::endl;
+  if (queries.empty()) {
+    std::cerr << "No queries to replay." << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  /* load the index */
+  my_index_t index;
+  idx_impact impact_index;
+  if (args.is_saat) {
+    load_impact_index(impact_index,args.files);
+  } else {
+    load_index(index,args.files);
+  }
+  if (args.budget.time_us != query_budget::unlimited) {
+    // calibrate the cycle counter now rather than in the first query
+    cycles_per_microsecond();
+  }
+
+  /* every worker reuses its own query buffers */
+  auto run_query = [&](const std::vector<query_token>& qry_tokens) -> result& {
+    static thread_local my_index_t::context_type ctx;
+    static thread_local idx_impact::context impact_ctx;
+    if (args.is_saat) {
+      return impact_index.search(impact_ctx,qry_tokens,args.k,
+                                 args.budget.max_pivots,false,args.budget);
+    }
+    return index.search(ctx,qry_tokens,args.k, false, false,
+                        args.is_exhaustive,
+                        args.ignore_low_impact_terms,
+                        args.budget);
+  };
+
+  /* the workers live across all rates. The stats of a rate are only
+     read and reset while no query is outstanding. */
+  concurrent_queue<arrival> arrivals;
+  std::vector<worker_stats> stats(args.num_threads);
+  std::atomic<uint64_t> completed(0);
+  std::vector<std::thread> workers;
+  for (size_t w=0;w<args.num_threads;w++) {
+    workers.emplace_back([&,w]() {
+      arrival a;
+      while (arrivals.pop(a)) {
+        auto start = clock_type::now();
+        const auto& res = run_query(std::get<1>(queries[a.query]));
+        auto stop = clock_type::now();
+        if (a.timed) {
+          auto& st = stats[w];
+          using std::chrono::duration_cast;
+          using std::chrono::microseconds;
+          st.latency.record(duration_cast<microseconds>(stop-a.scheduled).count());
+          st.queueing.record(duration_cast<microseconds>(start-a.scheduled).count());
+          st.service.record(duration_cast<microseconds>(stop-start).count());
+          if (res.budget_stopped) st.budget_hits++;
+          st.last_completion = stop;
+        }
+        completed.fetch_add(1,std::memory_order_release);
+      }
+    });
+  }
+  uint64_t issued = 0;
+  auto wait_for_completion = [&]() {
+    while (completed.load(std::memory_order_acquire) < issued) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  };
+
+  /* warm up every worker, nothing is recorded */
+  for (size_t i=0;i<args.warmup_runs;i++) {
+    std::cout << "Warm-up pass " << i+1 << "/" << args.warmup_runs << std::endl;
+    for (size_t q=0;q<queries.size();q++) {
+      arrivals.push(arrival{q,clock_type::now(),false});
+      issued++;
+    }
+    wait_for_completion();
+  }
+
+  /* one open-loop run per rate */
+  std::mt19937_64 gen(args.seed);
+  std::vector<rate_stats> runs;
+  double overloaded_rate = 0;
+  for (auto rate : args.rates) {
+    if (overloaded_rate > 0 && rate >= overloaded_rate) {
+      std::cout << "Skipping " << rate << " QPS, " << overloaded_rate
+                << " QPS already overloaded the index." << std::endl;
+      continue;
+    }
+    for (auto& st : stats) st = worker_stats();
+    rate_stats run;
+    run.offered_qps = rate;
+
+    // the schedule only depends on the rate and the seed, never on how
+    // fast queries are answered
+    std::exponential_distribution<double> inter_arrival(rate);
+    auto start = clock_type::now();
+    auto end = start + std::chrono::duration_cast<clock_type::duration>(
+                         std::chrono::duration<double>(args.duration_sec));
+    auto scheduled = start;
+    double dispatch_lag_us = 0;
+    size_t next_query = 0;
+    while (true) {
+      scheduled += std::chrono::duration_cast<clock_type::duration>(
+                     std::chrono::duration<double>(inter_arrival(gen)));
+      if (scheduled >= end) break;
+      wait_until(scheduled);
+      dispatch_lag_us += std::chrono::duration<double,std::micro>(
+                           clock_type::now() - scheduled).count();
+      arrivals.push(arrival{next_query,scheduled,true});
+      next_query = (next_query + 1) % queries.size();
+      issued++;
+      run.issued++;
+      if (issued - completed.load(std::memory_order_relaxed) > args.max_backlog) {
+        run.overloaded = true;
+        break;
+      }
+    }
+    wait_for_completion();
+
+    clock_type::time_point last = start;
+    for (const auto& st : stats) {
+      run.total.latency.merge(st.latency);
+      run.total.queueing.merge(st.queueing);
+      run.total.service.merge(st.service);
+      run.total.budget_hits += st.budget_hits;
+      if (st.latency.count() > 0) last = std::max(last,st.last_completion);
+    }
+    double elapsed = std::chrono::duration<double>(last - start).count();
+    if (elapsed > 0) run.achieved_qps = run.issued / elapsed;
+    if (run.issued > 0) run.mean_dispatch_lag_us = dispatch_lag_us / run.issued;
+    if (run.overloaded) overloaded_rate = rate;
+
+    const auto& lat = run.total.latency;
+    std::cout << "Offered " << rate << " QPS, achieved " << run.achieved_qps
+              << " QPS over " << run.issued << " queries"
+              << (run.overloaded ? " (OVERLOADED, gave up)" : "") << ". "
+              << "p50 = " << lat.value_at_percentile(50) / 1000.0
+              << " ms, p99 = " << lat.value_at_percentile(99) / 1000.0
+              << " ms, p99.9 = " << lat.value_at_percentile(99.9) / 1000.0
+              << " ms, queueing p99 = "
+              << run.total.queueing.value_at_percentile(99) / 1000.0
+              << " ms" << std::endl;
+    runs.push_back(std::move(run));
+  }
+  arrivals.close();
+  for (auto& w : workers) w.join();
+
+  /* one line per rate, the throughput-latency curve */
+  std::string load_file = args.output_prefix + "-load.csv";
+  std::cout << "Writing load results to '" << load_file << "'" << std::endl;
+  std::ofstream loadfs(load_file);
+  if (loadfs.is_open()) {
+    loadfs << "offered_qps;achieved_qps;queries;overloaded;threads;"
+           << "mean_ms;p50_ms;p90_ms;p99_ms;p999_ms;max_ms;"
+           << "queue_mean_ms;queue_p50_ms;queue_p99_ms;"
+           << "service_mean_ms;service_p50_ms;service_p99_ms;"
+           << "dispatch_lag_us;budget_hits;" << std::endl;
+    for (const auto& run : runs) {
+      const auto& lat = run.total.latency;
+      const auto& que = run.total.queueing;
+      const auto& svc = run.total.service;
+      loadfs << run.offered_qps << ";" << run.achieved_qps << ";"
+             << run.issued << ";" << run.overloaded << ";"
+             << args.num_threads << ";"
+             << lat.mean() / 1000.0 << ";"
+             << lat.value_at_percentile(50) / 1000.0 << ";"
+             << lat.value_at_percentile(90) / 1000.0 << ";"
+             << lat.value_at_percentile(99) / 1000.0 << ";"
+             << lat.value_at_percentile(99.9) / 1000.0 << ";"
+             << lat.max() / 1000.0 << ";"
+             << que.mean() / 1000.0 << ";"
+             << que.value_at_percentile(50) / 1000.0 << ";"
+             << que.value_at_percentile(99) / 1000.0 << ";"
+             << svc.mean() / 1000.0 << ";"
+             << svc.value_at_percentile(50) / 1000.0 << ";"
+             << svc.value_at_percentile(99) / 1000.0 << ";"
+             << run.mean_dispatch_lag_us << ";"
+             << run.total.budget_hits << std::endl;
+    }
+  } else {
+    perror ("Could not output load results to file.");
+  }
+
+  /* the full latency distribution of every rate */
+  std::string hist_file = args.output_prefix + "-load-histogram.log";
+  std::cout << "Writing latency histograms to '" << hist_file << "'" << std::endl;
+  std::ofstream histfs(hist_file);
+  if (histfs.is_open()) {
+    for (const auto& run : runs) {
+      histfs << "# offered QPS = " << run.offered_qps
+             << ", achieved QPS = " << run.achieved_qps
+             << ", threads = " << args.num_threads
+             << ", queries = " << run.issued << std::endl;
+      histfs << "# latency from scheduled arrival in ms" << std::endl;
+      run.total.latency.write_percentile_distribution(histfs,1000.0);
+      histfs << std::endl;
+    }
+  } else {
+    perror ("Could not output histogram to file.");
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -3,6 +3,7 @@
 #include <iostream>
 #include <iomanip>
 #include <ctime>
+#include <thread>
 
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -10,19 +11,42 @@
 #include "query.hpp"
 #include "invidx.hpp"
 #include "bm25.hpp"
+#include "rank_impact.hpp"
+#include "latency_histogram.hpp"
+#include "query_server.hpp"
+#include "docno_table.hpp"
+#include "impact_index.hpp"
+#include "index_loader.hpp"
+#include "tiered_index.hpp"
+#include "numa_util.hpp"
+#include "perf_counters.hpp"
+#include "result_overlap.hpp"
     
 typedef struct cmdargs {
     std::string collection_dir;
     std::string query_file;
-    std::string postings_file;
-    std::string F_t_file;
-    std::string df_t_file;
-    std::string doclen_file;
-    std::string global_file;
+    collection_files files;
     std::string output_prefix;
     bool ignore_low_impact_terms;
     bool is_exhaustive;
+    bool is_saat;
+    bool pruned;
+    bool tiered;
+    bool learned_impacts;
+    bool huge_pages;
+    bool hw_counters;
+    bool quality;
+    bool bm25_params;
+    double k1;
+    double b;
+    query_budget budget;
     uint64_t k;
+    uint64_t warmup_runs;
+    uint64_t num_runs;
+    uint64_t batch_size;
+    std::string serve;
+    uint64_t num_threads;
+    int64_t numa_nodes;
 } cmdargs_t;
 
 void
@@ -36,8 +60,38 @@ print_usage (char* program)
   fprintf(stdout,"  -k <top-k>  : the number of documents to be retrieved.\n");
   fprintf(stdout,"  -o <output> : prefix for output files.\n");
   fprintf(stdout,"  -e   : turn on exhaustive processing, defaults to wand.\n");
+  fprintf(stdout,"  -s   : score-at-a-time processing of the impact ordered");
+  fprintf(stdout," index (mk_wand_idx -I).\n");
+  fprintf(stdout,"  -p   : search the statically pruned index (mk_wand_idx");
+  fprintf(stdout," -P/-G), results are approximate.\n");
+  fprintf(stdout,"  -F   : search the pruned index first and the full index");
+  fprintf(stdout," only if its result is not safe.\n");
+  fprintf(stdout,"  -L   : the collection holds learned impacts");
+  fprintf(stdout," (mk_impact_idx), scores are f_qt * impact.\n");
+  fprintf(stdout,"  -K <k1,b> : BM25 parameters, default 0.9,0.4 (those of");
+  fprintf(stdout," the index).\n");
+  fprintf(stdout,"  -t <us> : time budget per query in microseconds.\n");
+  fprintf(stdout,"  -f <F> : select candidates against F times the threshold");
+  fprintf(stdout," (F >= 1), results are approximate.\n");
+  fprintf(stdout,"  -Q   : also run every query safely and report overlap@k,");
+  fprintf(stdout," rank-biased overlap and speedup (against the full index");
+  fprintf(stdout," with -p).\n");
+  fprintf(stdout,"  -b <work> : work budget per query, pivots (postings");
+  fprintf(stdout," for -s).\n");
+  fprintf(stdout,"  -H   : back the postings with transparent huge pages.\n");
+  fprintf(stdout,"  -C   : count cycles, instructions and cache, branch and");
+  fprintf(stdout," TLB misses of every query (perf_event_open).\n");
   fprintf(stdout,"  -i   : don't ignore terms where max impact < threshold,");
   fprintf(stdout," default is to ignore.\n");
+  fprintf(stdout,"  -w <runs>   : warm-up passes over the queries (not timed).\n");
+  fprintf(stdout,"  -r <runs>   : timed passes over the queries, default 1.\n");
+  fprintf(stdout,"  -B <queries> : evaluate batches of queries together,");
+  fprintf(stdout," sharing block decodes (wand only).\n");
+  fprintf(stdout,"  -S <socket> : serve queries on a unix domain socket");
+  fprintf(stdout," ('-' for stdin/stdout) instead of running a query file.\n");
+  fprintf(stdout,"  -T <threads> : worker threads in server mode.\n");
+  fprintf(stdout,"  -N <nodes> : in server mode, one index replica per NUMA");
+  fprintf(stdout," node (0) or per simulated node (>0).\n");
   exit(EXIT_FAILURE);
 };
 
@@ -49,17 +103,28 @@ parse_args(int argc,char* const argv[])
   args.collection_dir = "";
   args.output_prefix = "wand";
   args.is_exhaustive = false;
+  args.is_saat = false;
+  args.pruned = false;
+  args.tiered = false;
+  args.learned_impacts = false;
+  args.huge_pages = false;
+  args.hw_counters = false;
+  args.quality = false;
+  args.bm25_params = false;
+  args.k1 = my_rank_bm25<>::default_k1;
+  args.b = my_rank_bm25<>::default_b;
   args.ignore_low_impact_terms = true;
   args.k = 10;
-  while ((op=getopt(argc,argv,"c:q:k:o:ei")) != -1) {
+  args.warmup_runs = 0;
+  args.num_runs = 1;
+  args.batch_size = 1;
+  args.num_threads = std::max(1U,std::thread::hardware_concurrency());
+  args.numa_nodes = -1;
+  while ((op=getopt(argc,argv,"c:q:k:o:eispFLK:HCQt:b:f:w:r:B:S:T:N:")) != -1) {
     switch (op) {
       case 'c':
         args.collection_dir = optarg;
-        args.postings_file = args.collection_dir + "/WANDbl_postings.idx";
-        args.F_t_file = args.collection_dir +"/WANDbl_F_t.idx";
-        args.df_t_file = args.collection_dir +"/WANDbl_df_t.idx";
-        args.doclen_file = args.collection_dir +"/doc_lens.txt";
-        args.global_file = args.collection_dir +"/global.txt";
+        args.files = collection_files(args.collection_dir);
         break;
       case 'o':
         args.output_prefix = optarg;
@@ -73,117 +138,463 @@ parse_args(int argc,char* const argv[])
       case 'e':
         args.is_exhaustive = true;
         break;
+      case 's':
+        args.is_saat = true;
+        break;
+      case 'p':
+        args.pruned = true;
+        break;
+      case 'F':
+        args.tiered = true;
+        break;
+      case 'L':
+        args.learned_impacts = true;
+        break;
+      case 'H':
+        args.huge_pages = true;
+        break;
+      case 'C':
+        args.hw_counters = true;
+        break;
+      case 'Q':
+        args.quality = true;
+        break;
+      case 'f':
+        args.budget.threshold_factor = std::strtod(optarg,NULL);
+        break;
+      case 'K': {
+          args.bm25_params = true;
+          char* end = nullptr;
+          args.k1 = std::strtod(optarg,&end);
+          if (*end != ',') args.k1 = -1;
+          else args.b = std::strtod(end+1,NULL);
+        }
+        break;
+      case 't':
+        args.budget.time_us = std::strtoull(optarg,NULL,10);
+        break;
+      case 'b':
+        args.budget.max_pivots = std::strtoull(optarg,NULL,10);
+        break;
       case 'i':
         args.ignore_low_impact_terms = false;
         break;
+      case 'w':
+        args.warmup_runs = std::strtoul(optarg,NULL,10);
+        break;
+      case 'r':
+        args.num_runs = std::strtoul(optarg,NULL,10);
+        break;
+      case 'B':
+        args.batch_size = std::strtoul(optarg,NULL,10);
+        break;
+      case 'S':
+        args.serve = optarg;
+        break;
+      case 'T':
+        args.num_threads = std::strtoul(optarg,NULL,10);
+        break;
+      case 'N':
+        args.numa_nodes = std::strtol(optarg,NULL,10);
+        break;
       case '?':
       default:
         print_usage(argv[0]);
     }
   }
-  if (args.collection_dir==""||args.query_file=="") {
+  if (args.collection_dir==""||(args.query_file==""&&args.serve=="")) {
     std::cerr << "Missing command line parameters.\n";
     print_usage(argv[0]);
   }
+  if (args.num_runs == 0) {
+    std::cerr << "Need at least one timed run.\n";
+    print_usage(argv[0]);
+  }
+  if (args.batch_size == 0 ||
+      (args.batch_size > 1 && (args.is_exhaustive || args.is_saat))) {
+    std::cerr << "Batches need a batch size > 0 and wand processing.\n";
+    print_usage(argv[0]);
+  }
+  if (args.pruned) {
+    if (args.is_saat) {
+      std::cerr << "The impact ordered index is not pruned.\n";
+      print_usage(argv[0]);
+    }
+    args.files.postings_file = args.files.pruned_file;
+  }
+  if (args.learned_impacts && args.is_saat) {
+    std::cerr << "There is no impact ordered index of learned impacts.\n";
+    print_usage(argv[0]);
+  }
+  if (args.numa_nodes >= 0 && args.serve == "") {
+    std::cerr << "Index replicas per NUMA node (-N) need server mode (-S).\n";
+    print_usage(argv[0]);
+  }
+  if (args.tiered && (args.is_saat || args.pruned || args.batch_size > 1 ||
+                      args.numa_nodes >= 0)) {
+    std::cerr << "Tiered search does not work with -s, -p, -B or -N.\n";
+    print_usage(argv[0]);
+  }
+  if (args.k1 < 0 || args.b < 0 || args.b > 1) {
+    std::cerr << "BM25 needs k1 >= 0 and 0 <= b <= 1.\n";
+    print_usage(argv[0]);
+  }
+  // the impact ordered index and the pruning cutoffs hold BM25 scores
+  if (args.bm25_params &&
+      (args.learned_impacts || args.is_saat || args.tiered)) {
+    std::cerr << "BM25 parameters do not work with -L, -s or -F.\n";
+    print_usage(argv[0]);
+  }
+  if (!(args.budget.threshold_factor >= 1)) {
+    std::cerr << "The threshold factor must be at least 1.\n";
+    print_usage(argv[0]);
+  }
+  if ((args.budget.threshold_factor > 1 || args.quality) &&
+      (args.is_exhaustive || args.is_saat || args.tiered)) {
+    std::cerr << "The threshold factor needs WAND, not -e, -s or -F.\n";
+    print_usage(argv[0]);
+  }
+  if (args.quality && (args.batch_size > 1 || args.serve != "")) {
+    std::cerr << "Quality is measured per query, not with -B or -S.\n";
+    print_usage(argv[0]);
+  }
+  if (args.hw_counters && (args.batch_size > 1 || args.serve != "")) {
+    std::cerr << "Counters are per query, not available with -B or -S.\n";
+    print_usage(argv[0]);
+  }
   return args;
 }
 
-int 
-main (int argc,char* const argv[])
+// everything after parsing the arguments, for the index type of the
+// collection: BM25 on term frequencies or learned impacts (-L). The
+// ranker of the index is constructed with ranker_args.
+template<class t_index,class... t_ranker_args>
+int
+run_search(cmdargs_t& args,t_ranker_args... ranker_args)
 {
   /* define types */
-  using plist_type = block_postings_list<128>;
-  using my_index_t = idx_invfile<plist_type,my_rank_bm25<> >;
+  using my_index_t = t_index;
+  using my_tiered_index_t = tiered_index<my_index_t>;
   using clock = std::chrono::high_resolution_clock;
-  /* parse command line */
-  cmdargs_t args = parse_args(argc,argv);
-
-  // read warm-up queries if specified
-  std::vector<query_t> warm_queries;
+  if (args.serve == "-") {
+    // keep stdout free for the query protocol
+    std::cout.rdbuf(std::cerr.rdbuf());
+  }
 
   /* parse queries */
-  std::cout << "Parsing query file '" << args.query_file << "'" << std::endl;
-  auto queries = query_parser::parse_queries(args.collection_dir,args.query_file);
-  std::cout << "Found " << queries.size() << " queries." << std::endl;
+  std::vector<query_t> queries;
+  if (args.serve == "") {
+    std::cout << "Parsing query file '" << args.query_file << "'" << std::endl;
+    queries = query_parser::parse_queries(args.collection_dir,args.query_file);
+    std::cout << "Found " << queries.size() << " queries." << std::endl;
+  }
 
   std::string index_name(basename(strdup(args.collection_dir.c_str())));
 
   /* load the index */
   my_index_t index;
+  my_tiered_index_t tiered;
+  idx_impact impact_index;
   auto load_start = clock::now();
-  // Construct index instance.
-  construct(index, args.postings_file, args.F_t_file, args.df_t_file);
-
-  // Get vector of doc lengths and uint64 term count using asc file
-  uint64_t term_count = 0, temp;
-  std::vector<uint64_t>doc_lens;
-  doc_lens.reserve(131072); // Speed up load.
-  ifstream doclen_file(args.doclen_file);
-  if(doclen_file.is_open() != true){
-    std::cerr << "Couldn't open: " << args.doclen_file << std::endl;
-    exit(EXIT_FAILURE);
-  }
-  std::cout << "Reading document lengths." << std::endl;
-  /*Read the lengths of each document from asc file into vector*/
-  while(doclen_file >> temp){
-    doc_lens.push_back(temp);
-    term_count += temp;
-  }
-
-  if(args.global_file != "") {
-    ifstream global_file(args.global_file);
-    if(global_file.is_open() != true){
-      std::cerr << "Couldn't open: " << args.global_file << std::endl;
-      exit(EXIT_FAILURE);
-    }
-
-    uint64_t total_docs, total_terms;
-    global_file >> total_docs >> total_terms;
+  if (args.is_saat) {
+    load_impact_index(impact_index,args.files);
+  } else if (args.tiered) {
+    load_tiered_index(tiered,args.files);
+  } else {
+    load_index(index,args.files,ranker_args...);
+    if (args.bm25_params) load_pareto_bounds(index,args.files);
+  }
+  /* with -p -Q the safe runs search the full index */
+  my_index_t full_index;
+  if (args.pruned && args.quality) {
+    collection_files full_files(args.collection_dir);
+    load_index(full_index,full_files,ranker_args...);
+    if (args.bm25_params) load_pareto_bounds(full_index,full_files);
+  }
 
-    index.load(doc_lens, total_terms, total_docs);
+  if (args.huge_pages) {
+    size_t bytes = args.is_saat ? impact_index.advise_huge_pages()
+                 : args.tiered ? tiered.advise_huge_pages()
+                               : index.advise_huge_pages();
+    std::cout << "Advised " << bytes / (1024*1024)
+              << " MiB of postings to use huge pages." << std::endl;
   }
 
   auto load_stop = clock::now();
   auto load_time_sec = std::chrono::duration_cast<std::chrono::seconds>(load_stop-load_start);
   std::cout << "Index loaded in " << load_time_sec.count() << " seconds." << std::endl;
+  if (args.budget.time_us != query_budget::unlimited) {
+    // calibrate the cycle counter now rather than in the first query
+    std::cout << "Time budget " << args.budget.time_us << " us = "
+              << (uint64_t)(args.budget.time_us * cycles_per_microsecond())
+              << " cycles." << std::endl;
+  }
+
+  // the indexes used by the calling thread: the replica of its node in
+  // server mode with -N, otherwise the ones loaded above
+  static thread_local my_index_t* thread_index = nullptr;
+  static thread_local idx_impact* thread_impact_index = nullptr;
+  // with -C, the phases of the timed queries are counted here
+  query_phase_counters* query_phases = nullptr;
+
+  // every search thread reuses its own query buffers
+  auto run_query = [&](const std::vector<query_token>& qry_tokens,
+                       bool profile,const query_budget& budget) -> result& {
+    static thread_local typename my_index_t::context_type ctx;
+    static thread_local idx_impact::context impact_ctx;
+    static thread_local typename my_tiered_index_t::context_type tiered_ctx;
+    if (args.is_saat) {
+      auto& idx = thread_impact_index ? *thread_impact_index : impact_index;
+      return idx.search(impact_ctx,qry_tokens,args.k,
+                        budget.max_pivots,profile,budget);
+    }
+    if (args.tiered) {
+      return tiered.search(tiered_ctx,qry_tokens,args.k,false,profile,
+                           args.is_exhaustive,args.ignore_low_impact_terms,
+                           budget);
+    }
+    auto& idx = thread_index ? *thread_index : index;
+    ctx.phase_counters = query_phases;
+    return idx.search(ctx,qry_tokens,args.k, false, profile,
+                        args.is_exhaustive,
+                        args.ignore_low_impact_terms,
+                        budget);
+  };
+
+  if (args.serve != "") {
+    /* everything is loaded once, then queries are answered until EOF */
+    auto mapping = query_parser::load_dictionary(args.collection_dir);
+    auto doc_names = load_doc_names(args.collection_dir);
+    query_server server([&](const std::vector<query_token>& qry_tokens)
+                          -> const result& {
+                          return run_query(qry_tokens,false,args.budget);
+                        },mapping,doc_names);
+    /* replicate the index per node and pin the workers to the nodes */
+    numa_topology topo;
+    std::vector<std::unique_ptr<my_index_t>> replicas;
+    std::vector<std::unique_ptr<idx_impact>> impact_replicas;
+    query_server::worker_init_fn_t pin_worker;
+    if (args.numa_nodes >= 0) {
+      topo = (args.numa_nodes == 0) ? numa_topology::detect()
+                                    : numa_topology::simulate(args.numa_nodes);
+      std::cerr << "Replicating the index on " << topo.num_nodes()
+                << (topo.simulated ? " simulated" : "")
+                << " NUMA nodes." << std::endl;
+      if (args.is_saat) {
+        impact_replicas = replicate_per_node(impact_index,topo);
+        impact_index = idx_impact();
+      } else {
+        replicas = replicate_per_node(index,topo);
+        index = my_index_t();
+      }
+      pin_worker = [&](size_t worker) {
+        auto node = topo.node_of_worker(worker);
+        if (!pin_thread_to_cpus(topo.node_cpus[node])) {
+          std::cerr << "WARNING: could not pin worker " << worker
+                    << " to node " << node << std::endl;
+        }
+        if (args.is_saat) {
+          thread_impact_index = impact_replicas[node].get();
+        } else {
+          thread_index = replicas[node].get();
+        }
+      };
+    }
+    server.start(args.num_threads,pin_worker);
+    if (args.serve == "-") {
+      std::cerr << "Serving queries from stdin with " << args.num_threads
+                << " threads." << std::endl;
+      server.serve_stdin();
+    } else {
+      server.serve_socket(args.serve);
+    }
+    server.stop();
+    return EXIT_SUCCESS;
+  }
+
+  /* warm up caches and branch predictors, nothing is recorded */
+  for(size_t i=0;i<args.warmup_runs;i++) {
+    std::cout << "Warm-up pass " << i+1 << "/" << args.warmup_runs << std::endl;
+    for(const auto& query: queries) {
+      run_query(std::get<1>(query),false,args.budget);
+    }
+  }
 
   /* process the queries */
-  std::map<uint64_t,std::chrono::microseconds> query_times;
+  std::map<uint64_t,std::vector<std::chrono::microseconds>> query_times;
   std::map<uint64_t,result> query_results;
   std::map<uint64_t,uint64_t> query_lengths;
+  log_linear_histogram<> latency_hist;
+  std::chrono::microseconds batch_time(0);
+  uint64_t budget_hits = 0;
+  uint64_t first_tier_hits = 0;
 
-  size_t num_runs = 1;
-  for(size_t i=0;i<num_runs;i++) {
-    for(const auto& query: queries) {
-      auto id = std::get<0>(query);
-      auto qry_tokens = std::get<1>(query);
-      std::cout << "[" << id << "] |Q|=" << qry_tokens.size(); 
-      std::cout.flush();
-
-      // run the query
-      auto qry_start = clock::now();
-      auto results = index.search(qry_tokens,args.k, false, true, 
-                                  args.is_exhaustive, 
-                                  args.ignore_low_impact_terms);
-      auto qry_stop = clock::now();
-
-      auto query_time = std::chrono::duration_cast<std::chrono::microseconds>(qry_stop-qry_start);
-      std::cout << " TIME = " << std::setprecision(5)
-                << query_time.count() / 1000.0 
-                << " ms" << std::endl;
-
-      auto itr = query_times.find(id);
-      if(itr != query_times.end()) {
-        itr->second += query_time;
-      } else {
-        query_times[id] = query_time;
+  /* with -B every query of a batch is answered when the batch is */
+  typename my_index_t::batch_context_type batch_ctx;
+  std::vector<const std::vector<query_token>*> batch;
+  uint64_t shared_decodes = 0, shared_requests = 0;
+
+  /* with -C the hardware counters of this thread, summed over the runs */
+  std::unique_ptr<perf_counters> counters;
+  query_phase_counters phase_counters;
+  std::map<uint64_t,perf_values> query_counts;
+  std::map<uint64_t,std::array<perf_values,num_query_phases>> phase_counts;
+  if (args.hw_counters) {
+    counters.reset(new perf_counters());
+    if (counters->available()) {
+      for (size_t e=0;e<num_perf_events;e++) {
+        if (!counters->counts((perf_event_id)e)) {
+          std::cerr << "The " << perf_event_name(e) << " event is not"
+                    << " counted." << std::endl;
+        }
+      }
+      phase_counters.counters = counters.get();
+      query_phases = &phase_counters;
+    } else {
+      std::cerr << "Hardware counters are not available ("
+                << counters->error() << "), the counter columns of the"
+                << " timing log are NA." << std::endl;
+    }
+  }
+
+  /* with -Q every query also runs safely, without budget and factor, and
+     on the full index with -p. The safe run goes first in even runs and
+     last in odd ones, so neither always finds the caches warmed by the
+     other. */
+  std::map<uint64_t,std::vector<std::chrono::microseconds>> safe_times;
+  std::map<uint64_t,std::vector<doc_score>> safe_lists;
+  std::chrono::microseconds safe_time(0);
+  typename my_index_t::context_type full_ctx;
+  auto run_safe_query = [&](uint64_t id,
+                            const std::vector<query_token>& qry_tokens,
+                            bool keep) {
+    auto qry_start = clock::now();
+    auto& safe_res = args.pruned
+      ? full_index.search(full_ctx,qry_tokens,args.k,false,false,false,
+                          args.ignore_low_impact_terms)
+      : run_query(qry_tokens,false,query_budget());
+    auto qry_stop = clock::now();
+    auto t = std::chrono::duration_cast<std::chrono::microseconds>(qry_stop-qry_start);
+    safe_times[id].push_back(t);
+    safe_time += t;
+    if (keep) safe_lists[id] = safe_res.list;
+  };
+
+  for(size_t i=0;i<args.num_runs;i++) {
+    auto run_start = clock::now();
+    auto run_safe_time = safe_time;
+    for(size_t b=0;b<queries.size();b+=args.batch_size) {
+      size_t batch_end = std::min<size_t>(b+args.batch_size,queries.size());
+      std::chrono::microseconds query_time(0);
+      if (args.batch_size > 1) {
+        batch.clear();
+        for(size_t q=b;q<batch_end;q++) {
+          batch.push_back(&std::get<1>(queries[q]));
+        }
+        auto qry_start = clock::now();
+        index.search_batch(batch_ctx,batch,args.k,false,true,
+                           args.ignore_low_impact_terms,args.budget);
+        auto qry_stop = clock::now();
+        query_time = std::chrono::duration_cast<std::chrono::microseconds>(qry_stop-qry_start);
+        shared_decodes += batch_ctx.shared.decodes();
+        shared_requests += batch_ctx.shared.requests();
       }
+      for(size_t q=b;q<batch_end;q++) {
+        auto id = std::get<0>(queries[q]);
+        const auto& qry_tokens = std::get<1>(queries[q]);
+        if(i==0) {
+          std::cout << "[" << id << "] |Q|=" << qry_tokens.size();
+          std::cout.flush();
+          query_times[id].reserve(args.num_runs);
+        }
+
+        // run the query
+        result* results = nullptr;
+        if (args.batch_size > 1) {
+          results = &batch_ctx.res(q-b);
+        } else {
+          if (args.quality && i % 2 == 0) run_safe_query(id,qry_tokens,i==0);
+          perf_values counts_start, counts_stop;
+          if (counters) counters->read(counts_start);
+          auto qry_start = clock::now();
+          results = &run_query(qry_tokens,true,args.budget);
+          auto qry_stop = clock::now();
+          query_time = std::chrono::duration_cast<std::chrono::microseconds>(qry_stop-qry_start);
+          if (counters) {
+            counters->read(counts_stop);
+            query_counts[id] += counts_stop - counts_start;
+            auto& phases = phase_counts[id];
+            if (phase_counters.recorded) {
+              for (size_t p=0;p<num_query_phases;p++) {
+                phases[p] += phase_counters.phases[p];
+              }
+            }
+          }
+        }
+
+        query_times[id].push_back(query_time);
+        if (results->budget_stopped) budget_hits++;
+        if (results->first_tier) first_tier_hits++;
+        latency_hist.record(query_time.count());
+
+        if(i==0) {
+          std::cout << " TIME = " << std::setprecision(5)
+                    << query_time.count() / 1000.0
+                    << " ms" << std::endl;
+          query_results[id] = std::move(*results);
+          query_lengths[id] = qry_tokens.size();
+        }
+        if (args.quality && i % 2 == 1) run_safe_query(id,qry_tokens,false);
+      }
+    }
+    auto run_stop = clock::now();
+    batch_time += std::chrono::duration_cast<std::chrono::microseconds>(run_stop-run_start);
+    batch_time -= safe_time - run_safe_time;
+    if(i!=0) {
+      std::cout << "Run " << i+1 << "/" << args.num_runs << " done." << std::endl;
+    }
+  }
 
-      if(i==0) {
-        query_results[id] = results;
-        query_lengths[id] = qry_tokens.size();
+  double qps = 0;
+  if(batch_time.count() > 0) {
+    qps = (double)latency_hist.count() / (batch_time.count() / 1000000.0);
+  }
+  std::cout << "Processed " << latency_hist.count() << " queries in "
+            << batch_time.count() / 1000.0 << " ms (" << qps << " QPS). "
+            << "p50 = " << latency_hist.value_at_percentile(50) / 1000.0
+            << " ms, p95 = " << latency_hist.value_at_percentile(95) / 1000.0
+            << " ms, p99 = " << latency_hist.value_at_percentile(99) / 1000.0
+            << " ms" << std::endl;
+  if (args.batch_size > 1) {
+    std::cout << "Batches of " << args.batch_size << " queries decoded "
+              << shared_decodes << " of " << shared_requests
+              << " blocks of shared lists." << std::endl;
+  }
+  if (args.tiered) {
+    std::cout << first_tier_hits << " of " << latency_hist.count()
+              << " queries were answered by the pruned index." << std::endl;
+  }
+  if (args.budget.limited()) {
+    std::cout << budget_hits << " of " << latency_hist.count()
+              << " queries stopped at the budget." << std::endl;
+  }
+  if (counters && counters->available()) {
+    perf_values total;
+    for (const auto& counts : query_counts) total += counts.second;
+    total /= (double)latency_hist.count();
+    std::cout << "Mean per query:";
+    for (size_t e=0;e<num_perf_events;e++) {
+      if (total.valid[e]) {
+        std::cout << " " << (uint64_t)total.count[e] << " "
+                  << perf_event_name(e);
       }
     }
+    if (total.valid[perf_cycles] && total.valid[perf_instructions] &&
+        total.count[perf_cycles] > 0) {
+      std::cout << ", IPC = " << std::setprecision(3)
+                << total.count[perf_instructions] / total.count[perf_cycles];
+    }
+    std::cout << std::endl;
   }
 
   /* output results to csv */
@@ -192,6 +603,7 @@ main (int argc,char* const argv[])
   auto timeinfo = localtime (&t);
   strftime (time_buffer,80,"%F-%H:%M:%S",timeinfo);
   std::string search_type = (args.is_exhaustive) ? "exhaustive" : "wand";
+  if (args.is_saat) search_type = "saat";
   std::string qfile(basename(strdup(args.query_file.c_str())));
   std::string time_output_file = args.collection_dir + "/results/" 
              + search_type+"-timings-" + qfile + "-k" + std::to_string(args.k) 
@@ -200,47 +612,122 @@ main (int argc,char* const argv[])
              + search_type+"-results-" + qfile + "-k" + std::to_string(args.k) 
              + "-" + std::string(time_buffer) + ".csv";
 
-  /* calc average */
-  for(auto& timing : query_times) {
-    timing.second = timing.second / num_runs;
-  }
-
   std::string time_file = args.output_prefix + "-time.log";
 
   /* output */
   std::cout << "Writing timing results to '" << time_file << "'" << std::endl;     
   std::ofstream resfs(time_file);
   if(resfs.is_open()) {
-    resfs << "query;num_results;postings_eval;docs_fully_eval;docs_added_to_heap;threshold;num_terms;time_ms;" << std::endl;
-    for(const auto& timing: query_times) {
+    resfs << "query;num_results;postings_eval;docs_fully_eval;docs_added_to_heap;threshold;num_terms;time_ms;min_ms;median_ms;p95_ms;p99_ms;score_safe;budget_stopped;stop_doc_id;";
+    if (args.hw_counters) {
+      // whole query, then per phase of the document at a time searches
+      perf_values::write_header(resfs,"");
+      for (size_t p=0;p<num_query_phases;p++) {
+        perf_values::write_header(resfs,std::string(query_phase_name(p))+"_");
+      }
+    }
+    resfs << std::endl;
+    for(auto& timing: query_times) {
       auto qry_id = timing.first;
-      auto qry_time = timing.second;
-      auto results = query_results[qry_id];
+      auto& qry_times = timing.second;
+      std::sort(qry_times.begin(),qry_times.end());
+      auto qry_time = std::accumulate(qry_times.begin(),qry_times.end(),
+                                      std::chrono::microseconds(0)) / qry_times.size();
+      const auto& results = query_results[qry_id];
       resfs << qry_id << ";" << results.list.size() << ";" 
             << results.postings_evaluated << ";"
             << results.docs_fully_evaluated << ";" 
             << results.docs_added_to_heap << ";" 
             << results.final_threshold << ";" 
             << query_lengths[qry_id] << ";" 
-            << qry_time.count() / 1000.0 << std::endl;
+            << qry_time.count() / 1000.0 << ";"
+            << qry_times.front().count() / 1000.0 << ";"
+            << percentile(qry_times,50).count() / 1000.0 << ";"
+            << percentile(qry_times,95).count() / 1000.0 << ";"
+            << percentile(qry_times,99).count() / 1000.0 << ";"
+            << results.score_safe << ";"
+            << results.budget_stopped << ";"
+            << results.stop_doc_id;
+      if (args.hw_counters) {
+        // the mean of the runs
+        auto counts = query_counts[qry_id];
+        counts /= (double)qry_times.size();
+        counts.write(resfs);
+        for (auto phase : phase_counts[qry_id]) {
+          phase /= (double)qry_times.size();
+          phase.write(resfs);
+        }
+      }
+      resfs << std::endl;
     }
   } else {
     perror ("Could not output results to file.");
   }
 
-  // Write TREC output file.
+  std::string hist_file = args.output_prefix + "-histogram.log";
+  std::cout << "Writing latency histogram to '" << hist_file << "'" << std::endl;
+  std::ofstream histfs(hist_file);
+  if(histfs.is_open()) {
+    histfs << "# warm-up runs = " << args.warmup_runs
+           << ", timed runs = " << args.num_runs
+           << ", queries = " << queries.size()
+           << ", QPS = " << qps << std::endl;
+    histfs << "# latency in ms" << std::endl;
+    latency_hist.write_percentile_distribution(histfs,1000.0);
+  } else {
+    perror ("Could not output histogram to file.");
+  }
 
-  /* load the docnames map */
-  std::unordered_map<uint64_t,std::string> id_mapping;
-  std::string doc_names_file = args.collection_dir + "/doc_names.txt";
-  std::ifstream dfs(doc_names_file);
-  size_t j=0;
-  std::string name_mapping;
-  while( std::getline(dfs,name_mapping) ) {
-    id_mapping[j] = name_mapping;
-    j++;
+  /* with -Q, the agreement with and the speedup over the safe traversal */
+  if (args.quality) {
+    std::string quality_file = args.output_prefix + "-quality.csv";
+    std::cout << "Writing result quality to '" << quality_file << "'"
+              << std::endl;
+    std::ofstream qualfs(quality_file);
+    double overlap_sum = 0, rbo_sum = 0, safe_ms_sum = 0, time_ms_sum = 0;
+    if (qualfs.is_open()) {
+      qualfs << "query;overlap;rbo;safe_ms;time_ms;speedup;" << std::endl;
+    } else {
+      perror ("Could not output quality to file.");
+    }
+    for (const auto& timing: query_times) {
+      auto qry_id = timing.first;
+      const auto& safe_list = safe_lists[qry_id];
+      const auto& list = query_results[qry_id].list;
+      double overlap = overlap_at_k(safe_list,list,args.k);
+      double rbo = rank_biased_overlap(safe_list,list);
+      const auto& qry_safe_times = safe_times[qry_id];
+      double safe_ms = std::accumulate(qry_safe_times.begin(),
+                                       qry_safe_times.end(),
+                                       std::chrono::microseconds(0)).count()
+                       / 1000.0 / qry_safe_times.size();
+      double time_ms = std::accumulate(timing.second.begin(),
+                                       timing.second.end(),
+                                       std::chrono::microseconds(0)).count()
+                       / 1000.0 / timing.second.size();
+      overlap_sum += overlap;
+      rbo_sum += rbo;
+      safe_ms_sum += safe_ms;
+      time_ms_sum += time_ms;
+      qualfs << qry_id << ";" << overlap << ";" << rbo << ";" << safe_ms
+             << ";" << time_ms << ";";
+      if (time_ms > 0) qualfs << safe_ms / time_ms << std::endl;
+      else qualfs << "NA" << std::endl;
+    }
+    size_t n = std::max<size_t>(1,query_times.size());
+    std::cout << (args.pruned ? "Pruned index, threshold factor "
+                              : "Threshold factor ")
+              << args.budget.threshold_factor
+              << ": mean overlap@" << args.k << " = " << overlap_sum / n
+              << ", mean RBO = " << rbo_sum / n << ", "
+              << (time_ms_sum > 0 ? safe_ms_sum / time_ms_sum : 0)
+              << " times as fast as the safe traversal." << std::endl;
   }
- 
+
+  // Write TREC output file.
+
+  /* map the docno table, only the names of the results are decoded */
+  auto doc_names = load_doc_names(args.collection_dir);
 
   std::string trec_file = args.output_prefix + "-trec.run";
   std::cout << "Writing trec output to " << trec_file << std::endl;
@@ -248,11 +735,11 @@ main (int argc,char* const argv[])
   if(trec_out.is_open()) {
     for(const auto& result: query_results) {
       auto qry_id = result.first;
-      auto qry_res = result.second.list;
+      const auto& qry_res = result.second.list;
       for(size_t i=1;i<=qry_res.size();i++) {
         trec_out << qry_id << "\t"
                  << "Q0" << "\t"
-                 << id_mapping[qry_res[i-1].doc_id] << "\t"
+                 << doc_names[qry_res[i-1].doc_id] << "\t"
                  << i << "\t"
                  << qry_res[i-1].score << "\t"  
                  << "WANDbl" << std::endl;
@@ -264,3 +751,16 @@ main (int argc,char* const argv[])
 
   return EXIT_SUCCESS;
 }
+
+int 
+main (int argc,char* const argv[])
+{
+  using plist_type = block_postings_list<128>;
+  /* parse command line */
+  cmdargs_t args = parse_args(argc,argv);
+  if (args.learned_impacts) {
+    return run_search<idx_invfile<plist_type,my_rank_impact>>(args);
+  }
+  return run_search<idx_invfile<plist_type,my_rank_bm25<>>>(args,args.k1,
+                                                            args.b);
+}
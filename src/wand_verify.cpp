@@ -0,0 +1,565 @@
+#include <unistd.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <iomanip>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "query.hpp"
+#include "invidx.hpp"
+#include "bm25.hpp"
+#include "rank_impact.hpp"
+#include "pareto_bounds.hpp"
+#include "static_pruning.hpp"
+#include "tiered_index.hpp"
+#include "impact_index.hpp"
+#include "synthetic_index.hpp"
+
+typedef struct cmdargs {
+    uint64_t num_docs;
+    uint64_t vocab_size;
+    uint64_t num_queries;
+    uint64_t seed;
+} cmdargs_t;
+
+void
+print_usage (char* program)
+{
+  fprintf(stdout,"%s [-n <docs>] [-t <terms>] [-q <queries>] [-s <seed>]\n",
+          program);
+  fprintf(stdout,"where\n");
+  fprintf(stdout,"  -n <docs>    : number of synthetic documents.\n");
+  fprintf(stdout,"  -t <terms>   : vocabulary size.\n");
+  fprintf(stdout,"  -q <queries> : queries per query set.\n");
+  fprintf(stdout,"  -s <seed>    : random seed.\n");
+  exit(EXIT_FAILURE);
+};
+
+cmdargs_t
+parse_args(int argc,char* const argv[])
+{
+  cmdargs_t args;
+  int op;
+  args.num_docs = 100000;
+  args.vocab_size = 5000;
+  args.num_queries = 30;
+  args.seed = 4711;
+  while ((op=getopt(argc,argv,"n:t:q:s:")) != -1) {
+    switch (op) {
+      case 'n':
+        args.num_docs = std::strtoull(optarg,NULL,10);
+        break;
+      case 't':
+        args.vocab_size = std::strtoull(optarg,NULL,10);
+        break;
+      case 'q':
+        args.num_queries = std::strtoull(optarg,NULL,10);
+        break;
+      case 's':
+        args.seed = std::strtoull(optarg,NULL,10);
+        break;
+      case '?':
+      default:
+        print_usage(argv[0]);
+    }
+  }
+  // the edge case lists need a few thousand documents
+  if (args.num_docs < 4096 || args.vocab_size < 1024 ||
+      args.num_queries == 0) {
+    std::cerr << "Invalid command line parameters.\n";
+    print_usage(argv[0]);
+  }
+  return args;
+}
+
+using plist_type = block_postings_list<128>;
+using bm25_index_t = idx_invfile<plist_type,my_rank_bm25<>>;
+using impact_index_t = idx_invfile<plist_type,my_rank_impact>;
+
+// the top-k lists of all queries of a query set
+using result_lists = std::vector<std::vector<doc_score>>;
+using query_set = std::pair<std::string,std::vector<query_t>>;
+
+// A way of answering queries that must be rank safe: it answers every
+// query of a set with (at most) k results, with or without
+// ignore_low_impact.
+struct engine {
+  std::string name;
+  std::function<void(const std::vector<query_t>&,size_t,bool,
+                     result_lists&)> run;
+};
+
+const size_t k_values[] = {1,10,100,1000};
+const size_t max_k = 1000;
+
+// exactly n distinct sorted doc ids from [0,num_docs)
+std::vector<uint64_t>
+exact_doc_ids(std::mt19937_64& gen,uint64_t num_docs,uint64_t n)
+{
+  std::vector<uint64_t> ids(num_docs);
+  for (uint64_t d=0;d<num_docs;d++) ids[d] = d;
+  std::shuffle(ids.begin(),ids.end(),gen);
+  ids.resize(n);
+  std::sort(ids.begin(),ids.end());
+  return ids;
+}
+
+// Append terms whose lists exercise the edge cases of the postings and of
+// the traversals: a list of one posting at either end of the collection,
+// lists of 127 postings (a single vbyte coded tail block), 128 (a single
+// full block), 129 (a full block and a tail of one) and 256 (two full
+// blocks), a list that ends within the first 2% of the documents, a dense
+// list stored as a bitmap and a short list of very high frequencies.
+// Returns the ids of the terms.
+std::vector<uint64_t>
+add_edge_case_terms(synthetic_collection& col,uint64_t seed)
+{
+  std::mt19937_64 gen(seed);
+  std::geometric_distribution<uint64_t> fdist(0.55);
+  uint64_t n = col.num_docs;
+  std::vector<std::vector<uint64_t>> id_lists = {
+    {0},
+    {n-1},
+    exact_doc_ids(gen,n,127),
+    exact_doc_ids(gen,n,128),
+    exact_doc_ids(gen,n,129),
+    exact_doc_ids(gen,n,256),
+    exact_doc_ids(gen,n/50,n/100),
+    {},
+    exact_doc_ids(gen,n,40),
+  };
+  for (uint64_t d=0;d<n;d+=2) id_lists[7].push_back(d);
+
+  std::vector<uint64_t> terms;
+  for (size_t l=0;l<id_lists.size();l++) {
+    const auto& ids = id_lists[l];
+    terms.push_back(col.postings.size());
+    col.postings.emplace_back();
+    for (auto id : ids) {
+      uint64_t f_dt = (l == 8) ? 40 + fdist(gen) : 1 + fdist(gen);
+      col.postings.back().emplace_back(id,f_dt);
+      col.doc_lengths[id] += f_dt;
+      col.num_terms += f_dt;
+    }
+  }
+  return terms;
+}
+
+// queries of few frequent terms, of rarer terms, of edge case terms mixed
+// with frequent ones, and long queries that are processed with MaxScore
+std::vector<query_set>
+make_query_sets(const synthetic_collection& col,
+                const std::vector<uint64_t>& edge_terms,
+                const cmdargs_t& args)
+{
+  std::vector<query_set> sets;
+  size_t vocab = args.vocab_size;
+  sets.emplace_back("short",make_synthetic_queries(col,args.num_queries,3,
+                                                   64,args.seed+1));
+  sets.emplace_back("rare",make_synthetic_queries(col,args.num_queries,4,
+                                                  vocab,args.seed+2));
+  auto long_queries = make_synthetic_queries(col,args.num_queries/2+1,20,
+                                             256,args.seed+3);
+  auto longer = make_synthetic_queries(col,args.num_queries/2+1,50,1024,
+                                       args.seed+4);
+  long_queries.insert(long_queries.end(),longer.begin(),longer.end());
+  sets.emplace_back("long",long_queries);
+
+  // every edge case term, with one to three frequent or rare terms
+  std::mt19937_64 gen(args.seed+5);
+  std::vector<query_t> edge_queries;
+  for (size_t q=0;q<std::max<size_t>(args.num_queries,edge_terms.size());q++) {
+    std::vector<uint64_t> ids = {edge_terms[q % edge_terms.size()]};
+    if (q % 3 == 0) ids.push_back(edge_terms[gen() % edge_terms.size()]);
+    size_t others = 1 + gen() % 3;
+    for (size_t i=0;i<others;i++) {
+      ids.push_back((q % 2) ? gen() % 32 : gen() % vocab);
+    }
+    std::sort(ids.begin(),ids.end());
+    ids.erase(std::unique(ids.begin(),ids.end()),ids.end());
+    std::vector<query_token> tokens;
+    for (auto id : ids) {
+      tokens.emplace_back(std::vector<uint64_t>(1,id),
+                          std::vector<std::string>(),1);
+    }
+    edge_queries.emplace_back(q,tokens);
+  }
+  sets.emplace_back("edge",edge_queries);
+  return sets;
+}
+
+// the same queries with term weights, as of learned sparse queries
+std::vector<query_set>
+weight_query_sets(std::vector<query_set> sets,uint64_t seed)
+{
+  std::mt19937_64 gen(seed);
+  std::uniform_real_distribution<double> weight(0.05,4.0);
+  for (auto& set : sets) {
+    for (auto& q : set.second) {
+      for (auto& token : std::get<1>(q)) token.f_qt = weight(gen);
+    }
+    set.first += " (weighted)";
+  }
+  return sets;
+}
+
+// Compare the result of an engine with the exhaustive result of a deeper
+// k. They agree if they have as many documents as the top k has and the
+// same document with the same score at every rank. Ties are broken by
+// doc id (see doc_score), so the top k is unique.
+bool
+same_top_k(const std::vector<doc_score>& reference,size_t k,
+           const std::vector<doc_score>& got,std::string& why)
+{
+  std::ostringstream out;
+  size_t n = std::min(k,reference.size());
+  if (got.size() != n) {
+    out << got.size() << " results instead of " << n;
+    why = out.str();
+    return false;
+  }
+  for (size_t i=0;i<n;i++) {
+    if (got[i].doc_id != reference[i].doc_id ||
+        got[i].score != reference[i].score) {
+      out << std::setprecision(17) << "rank " << i+1 << ": doc "
+          << got[i].doc_id << " scores " << got[i].score
+          << ", expected doc " << reference[i].doc_id << " scoring "
+          << reference[i].score;
+      why = out.str();
+      return false;
+    }
+  }
+  return true;
+}
+
+// checks and failures of all engines
+struct verifier {
+  uint64_t checks = 0;
+  uint64_t failures = 0;
+
+  // run every engine on every query set and k, with and without
+  // ignore_low_impact, against the results of reference at a depth of
+  // max_k+32
+  void verify(const std::string& index_name,const engine& reference,
+              const std::vector<engine>& engines,
+              const std::vector<query_set>& sets) {
+    std::vector<uint64_t> engine_checks(engines.size(),0);
+    std::vector<uint64_t> engine_failures(engines.size(),0);
+    result_lists expected, got;
+    for (bool ignore_low_impact : {false,true}) {
+      for (const auto& set : sets) {
+        reference.run(set.second,max_k+32,ignore_low_impact,expected);
+        for (size_t k : k_values) {
+          for (size_t e=0;e<engines.size();e++) {
+            engines[e].run(set.second,k,ignore_low_impact,got);
+            for (size_t q=0;q<set.second.size();q++) {
+              std::string why;
+              engine_checks[e]++;
+              if (same_top_k(expected[q],k,got[q],why)) continue;
+              if (engine_failures[e]++ < 5) {
+                std::cout << "MISMATCH " << index_name << " "
+                          << engines[e].name << ", " << set.first
+                          << " query " << std::get<0>(set.second[q])
+                          << ", k=" << k << ", ignore_low_impact="
+                          << ignore_low_impact << ": " << why << std::endl;
+              }
+            }
+          }
+        }
+      }
+    }
+    for (size_t e=0;e<engines.size();e++) {
+      std::cout << std::left << std::setw(22) << index_name
+                << std::setw(22) << engines[e].name << std::right
+                << std::setw(8) << engine_checks[e] << " results, "
+                << engine_failures[e] << " wrong" << std::endl;
+      checks += engine_checks[e];
+      failures += engine_failures[e];
+    }
+  }
+};
+
+// idx_invfile::search with max_wand_terms set, exhaustive or not
+template<class t_index>
+engine
+search_engine(const std::string& name,t_index& index,size_t max_wand_terms,
+              bool exhaustive = false,bool ranked_and = false,
+              bool prefetch = true)
+{
+  return {name,[&index,max_wand_terms,exhaustive,ranked_and,prefetch]
+    (const std::vector<query_t>& queries,size_t k,bool ignore_low_impact,
+     result_lists& out) {
+    typename t_index::context_type ctx;
+    ctx.prefetch_next_block = prefetch;
+    query_budget budget;
+    budget.max_wand_terms = max_wand_terms;
+    out.clear();
+    for (const auto& q : queries) {
+      out.push_back(index.search(ctx,std::get<1>(q),k,ranked_and,false,
+                                 exhaustive,ignore_low_impact,budget).list);
+    }
+  }};
+}
+
+// idx_invfile::search_batch with batches of 8 queries
+template<class t_index>
+engine
+batch_engine(const std::string& name,t_index& index,bool prefetch = true,
+             bool ranked_and = false)
+{
+  return {name,[&index,prefetch,ranked_and]
+    (const std::vector<query_t>& queries,size_t k,bool ignore_low_impact,
+     result_lists& out) {
+    typename t_index::batch_context_type bctx;
+    bctx.prefetch_next_block = prefetch;
+    std::vector<const std::vector<query_token>*> batch;
+    out.clear();
+    for (size_t b=0;b<queries.size();b+=8) {
+      batch.clear();
+      for (size_t q=b;q<std::min<size_t>(b+8,queries.size());q++) {
+        batch.push_back(&std::get<1>(queries[q]));
+      }
+      index.search_batch(bctx,batch,k,ranked_and,false,ignore_low_impact);
+      for (size_t i=0;i<batch.size();i++) out.push_back(bctx.res(i).list);
+    }
+  }};
+}
+
+// the engines of a document at a time index and their settings
+template<class t_index>
+std::vector<engine>
+index_engines(t_index& index)
+{
+  size_t max_terms = std::numeric_limits<size_t>::max();
+  std::vector<engine> engines = {
+    search_engine("wand",index,max_terms),
+    search_engine("maxscore",index,0),
+    search_engine("wand/maxscore",index,query_budget().max_wand_terms),
+    search_engine("wand (no prefetch)",index,max_terms,false,false,false),
+  };
+  engines.push_back(batch_engine("search_batch (b=8)",index));
+  engines.push_back(batch_engine("batch (no prefetch)",index,false));
+  return engines;
+}
+
+// The pruned tier of a collection and the highest dropped scores, as
+// mk_wand_idx -P writes and wand_search -p reads them.
+// the impact ordered index of mk_wand_idx -I over a synthetic collection
+idx_impact
+make_impact_ordered_index(synthetic_collection col,uint32_t bits)
+{
+  my_rank_bm25<> ranker(col.doc_lengths,col.num_terms,col.num_docs);
+  std::vector<plist_type> lists;
+  for (auto& post : col.postings) lists.emplace_back(ranker,post);
+  return idx_impact(lists,ranker,col.num_docs,bits);
+}
+
+// The exact score-at-a-time result: every document scores the sum of the
+// stored impacts of the query terms times their weights, rounded as
+// idx_impact::search rounds them. No weight of the query sets is large
+// enough to overflow an accumulator, so none is scaled down.
+engine
+impact_sum_engine(const idx_impact& index)
+{
+  return {"exhaustive",[&index](const std::vector<query_t>& queries,size_t k,
+                                bool,result_lists& out) {
+    std::vector<uint64_t> scores(index.num_docs());
+    std::vector<doc_score> top;
+    out.clear();
+    for (const auto& q : queries) {
+      std::fill(scores.begin(),scores.end(),0);
+      for (const auto& token : std::get<1>(q)) {
+        index.for_each_posting(token.token_ids[0],
+          [&scores,&token](uint64_t doc_id,uint32_t impact) {
+            scores[doc_id] += std::llround(std::max(0.0,impact*token.f_qt));
+          });
+      }
+      top.clear();
+      for (uint64_t d=0;d<scores.size();d++) {
+        if (scores[d]) top.emplace_back(d,scores[d]);
+      }
+      size_t n = std::min(k,top.size());
+      std::partial_sort(top.begin(),top.begin()+n,top.end(),
+                        std::greater<doc_score>());
+      out.emplace_back(top.begin(),top.begin()+n);
+    }
+  }};
+}
+
+// idx_impact::search, with the default budget or with an explicitly
+// unlimited budget of postings and time as wand_search -s passes it
+engine
+saat_engine(const std::string& name,const idx_impact& index,
+            bool explicit_budget)
+{
+  return {name,[&index,explicit_budget]
+    (const std::vector<query_t>& queries,size_t k,bool,result_lists& out) {
+    idx_impact::context ctx;
+    query_budget budget;
+    budget.time_us = query_budget::unlimited;
+    budget.max_pivots = idx_impact::unlimited;
+    out.clear();
+    for (const auto& q : queries) {
+      if (explicit_budget) {
+        out.push_back(index.search(ctx,std::get<1>(q),k,budget.max_pivots,
+                                   true,budget).list);
+      } else {
+        out.push_back(index.search(ctx,std::get<1>(q),k).list);
+      }
+    }
+  }};
+}
+
+template<class t_index>
+t_index
+make_pruned_tier(const synthetic_collection& col,const pruning_params& params,
+                 std::vector<double>& cutoffs,pruning_stats& stats)
+{
+  using ranker_type = typename t_index::ranker_type;
+  ranker_type ranker(col.doc_lengths,col.num_terms,col.num_docs);
+  std::vector<plist_type> lists(col.postings.size());
+  sdsl::int_vector<> F_t(col.postings.size());
+  sdsl::int_vector<> f_t(col.postings.size());
+  cutoffs.assign(col.postings.size(),0);
+  for (size_t t=0;t<col.postings.size();t++) {
+    auto post = col.postings[t];
+    uint64_t sum = 0;
+    for (const auto& p : post) sum += p.second;
+    F_t[t] = sum;
+    f_t[t] = post.size();
+    plist_type pruned;
+    cutoffs[t] = prune_list(post,ranker,params,stats,pruned);
+    std::stringstream buf;
+    sdsl::serialize(pruned,buf);
+    lists[t] = plist_type(buf);
+  }
+  t_index tier(std::move(lists),std::move(F_t),std::move(f_t));
+  tier.load(col.doc_lengths,col.num_terms,col.num_docs);
+  return tier;
+}
+
+int
+main (int argc,char* const argv[])
+{
+  cmdargs_t args = parse_args(argc,argv);
+
+  std::cout << "Generating synthetic collection with " << args.num_docs
+            << " documents and " << args.vocab_size << " terms." << std::endl;
+  auto col = make_zipf_collection(args.num_docs,args.vocab_size,1.0,0.3,
+                                  args.seed);
+  auto edge_terms = add_edge_case_terms(col,args.seed);
+  auto sets = make_query_sets(col,edge_terms,args);
+  verifier v;
+
+  {
+    bm25_index_t index;
+    construct_synthetic(index,col);
+    auto reference = search_engine("exhaustive",index,0,true);
+    v.verify("bm25",reference,index_engines(index),sets);
+    // conjunctive queries against the exhaustive conjunctive search
+    v.verify("bm25 (ranked and)",search_engine("exhaustive",index,0,true,true),
+             {search_engine("wand",index,0,false,true),
+              batch_engine("search_batch (b=8)",index,true,true)},sets);
+  }
+
+  {
+    bm25_index_t index;
+    construct_synthetic(index,col,false);
+    v.verify("bm25 (no bitmaps)",search_engine("exhaustive",index,0,true),
+             index_engines(index),sets);
+  }
+
+  // the pruned tier and the full index; results are those of the full
+  // index whichever answers. The global cutoff of the second tier is above
+  // all scores of the most frequent term, whose list and others are
+  // emptied.
+  bm25_index_t reference_index;
+  construct_synthetic(reference_index,col);
+  pruning_params top_k_params, cutoff_params;
+  top_k_params.top_k = 64;
+  cutoff_params.top_k = 64;
+  cutoff_params.global_cutoff =
+    1.001 * reference_index.postings().list(0).list_max_score();
+  for (const auto& params : {top_k_params,cutoff_params}) {
+    std::vector<double> cutoffs;
+    pruning_stats stats;
+    auto tier = make_pruned_tier<bm25_index_t>(col,params,cutoffs,stats);
+    std::cout << "Tier of top " << params.top_k << " postings per list";
+    if (params.global_cutoff > 0) {
+      std::cout << " scoring at least " << params.global_cutoff;
+    }
+    std::cout << ": " << stats.lists_emptied << " lists emptied."
+              << std::endl;
+    bm25_index_t full;
+    construct_synthetic(full,col);
+    tiered_index<bm25_index_t> tiered(std::move(tier),std::move(full),
+                                      std::move(cutoffs));
+    for (bool exhaustive : {false,true}) {
+      engine e = {exhaustive ? "tiered (exhaustive)" : "tiered (wand)",
+        [&tiered,exhaustive](const std::vector<query_t>& queries,size_t k,
+                             bool ignore_low_impact,result_lists& out) {
+          tiered_index<bm25_index_t>::context_type ctx;
+          out.clear();
+          for (const auto& q : queries) {
+            out.push_back(tiered.search(ctx,std::get<1>(q),k,false,false,
+                                        exhaustive,ignore_low_impact).list);
+          }
+        }};
+      v.verify(params.global_cutoff > 0 ? "bm25 (tiered, cutoff)"
+                                        : "bm25 (tiered)",
+               search_engine("exhaustive",reference_index,0,true),{e},sets);
+    }
+  }
+
+  {
+    // weighted queries on an index of impacts
+    impact_index_t index;
+    construct_synthetic(index,col);
+    v.verify("impact",search_engine("exhaustive",index,0,true),
+             index_engines(index),weight_query_sets(sets,args.seed+6));
+  }
+
+  {
+    // BM25 parameters other than those of the list maxima, which are
+    // recomputed from the Pareto sets of the lists
+    bm25_index_t index;
+    construct_synthetic(index,col);
+    index.load(col.doc_lengths,col.num_terms,col.num_docs,1.6,0.95);
+    std::vector<pareto_bounds::pareto_set> pareto_sets;
+    for (const auto& post : col.postings) {
+      pareto_sets.push_back(pareto_bounds::make_set(post,col.doc_lengths));
+    }
+    index.set_list_maxima(pareto_bounds(pareto_sets));
+    v.verify("bm25 (k1=1.6,b=0.95)",search_engine("exhaustive",index,0,true),
+             index_engines(index),sets);
+  }
+
+  // score-at-a-time processing of the impact ordered index, of plain and
+  // of weighted queries
+  auto saat_sets = sets;
+  auto weighted = weight_query_sets(sets,args.seed+6);
+  saat_sets.insert(saat_sets.end(),weighted.begin(),weighted.end());
+  for (uint32_t bits : {8,16}) {
+    auto index = make_impact_ordered_index(col,bits);
+    v.verify("saat (" + std::to_string(bits) + " bits)",
+             impact_sum_engine(index),
+             {saat_engine("saat",index,false),
+              saat_engine("saat (unlimited)",index,true)},saat_sets);
+  }
+
+  if (v.failures) {
+    std::cout << v.failures << " of " << v.checks
+              << " results differ from exhaustive evaluation." << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::cout << "All " << v.checks << " results are those of exhaustive"
+            << " evaluation." << std::endl;
+  return EXIT_SUCCESS;
+}